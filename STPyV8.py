@@ -24,16 +24,22 @@ __all__ = [
     "JSUndefined",
     "JSArray",
     "JSFunction",
+    "JSPreparedCall",
+    "JSBuffer",
     "JSClass",
     "JSEngine",
     "JSContext",
     "JSIsolate",
+    "JSIsolatePool",
+    "JSPooledIsolate",
+    "JSCpuProfile",
     "JSStackTrace",
     "JSStackFrame",
     "JSScript",
     "JSLocker",
     "JSUnlocker",
     "JSPlatform",
+    "to_python",
 ]
 
 
@@ -156,9 +162,19 @@ JSNull = _STPyV8.JSNull
 JSUndefined = _STPyV8.JSUndefined
 JSArray = _STPyV8.JSArray
 JSFunction = _STPyV8.JSFunction
+JSPreparedCall = _STPyV8.JSPreparedCall
+JSBuffer = _STPyV8.JSBuffer
 JSPlatform = _STPyV8.JSPlatform
 
 
+def to_python(value, depth=None):
+    """Converts a Javascript value to plain dicts, lists and scalars, see JSObject.to_python"""
+    if isinstance(value, JSObject):
+        return value.to_python(depth)
+
+    return value
+
+
 class JSLocker(_STPyV8.JSLocker):
     def __enter__(self):
         self.enter()
@@ -341,6 +357,8 @@ JSStackFrame = _STPyV8.JSStackFrame
 
 
 class JSIsolate(_STPyV8.JSIsolate):
+    HeapLimitPolicy = _STPyV8.JSHeapLimitPolicy
+
     def __enter__(self):
         self.enter()
         return self
@@ -350,6 +368,18 @@ class JSIsolate(_STPyV8.JSIsolate):
         del self
 
 
+class JSIsolatePool(_STPyV8.JSIsolatePool):
+    def checkout(self, timeout=None):
+        return _STPyV8.JSIsolatePool.checkout(self, -1 if timeout is None else timeout)
+
+
+JSPooledIsolate = _STPyV8.JSPooledIsolate
+JSPooledIsolate.__enter__ = lambda self: self
+JSPooledIsolate.__exit__ = lambda self, exc_type, exc_value, traceback: self.release()
+
+JSCpuProfile = _STPyV8.JSCpuProfile
+
+
 class JSContext(_STPyV8.JSContext):
     def __init__(self, obj=None, ctxt=None):
         self.lock = JSLocker()
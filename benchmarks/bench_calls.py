@@ -0,0 +1,51 @@
+#!/usr/bin/env python
+
+# bench_calls.py - throughput of the calls between Python and Javascript by arity
+
+import timeit
+
+import STPyV8
+
+ARITIES = (0, 3, 16)
+CALLS = 100000
+
+
+def callback(*args):
+    return len(args)
+
+
+def report(name, arity, number, elapsed):
+    print(f"{name:>10} {arity:>3} args: {number / elapsed:12.0f} calls/s")
+
+
+class Receiver:
+    def method(self, *args):
+        return len(args)
+
+
+with STPyV8.JSContext() as ctxt:
+    loop = ctxt.eval(
+        """
+    (function (f, n, count) {
+        var args = Array.from({length: n}, (_, i) => i);
+        var s = 0;
+        for (var i = 0; i < count; i++) { s += f.apply(null, args); }
+        return s;
+    })
+    """
+    )
+
+    for arity in ARITIES:
+        elapsed = timeit.timeit(lambda: loop(callback, arity, CALLS), number=1)
+        report("function", arity, CALLS, elapsed)
+
+        elapsed = timeit.timeit(lambda: loop(Receiver().method, arity, CALLS), number=1)
+        report("method", arity, CALLS, elapsed)
+
+    count = ctxt.eval("(function () { return arguments.length; })")
+
+    for arity in ARITIES:
+        args = tuple(range(arity))
+
+        elapsed = timeit.timeit(lambda: count(*args), number=CALLS)
+        report("py -> js", arity, CALLS, elapsed)
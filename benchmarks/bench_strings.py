@@ -0,0 +1,43 @@
+#!/usr/bin/env python
+
+# bench_strings.py - throughput of the string conversions between Python and Javascript
+
+import timeit
+
+import STPyV8
+
+SIZES = (16, 1024, 1024 * 1024)
+
+SAMPLES = {
+    "ascii": "a",
+    "latin-1": "\xe9",
+    "bmp": "人",
+    "astral": "\U0001f600",
+}
+
+
+def report(direction, name, size, number, elapsed):
+    print(
+        f"{direction} {name:>8} {size:>8} chars: {number / elapsed:12.0f} calls/s "
+        f"{number * size / elapsed / 1024 / 1024:10.1f} Mchars/s"
+    )
+
+
+with STPyV8.JSContext() as ctxt:
+    length = ctxt.eval("(function (s) { return s.length; })")
+    maker = ctxt.eval(
+        "(function (c, n) { var s = c.repeat(n); return function () { return s; }; })"
+    )
+
+    for name, char in SAMPLES.items():
+        for size in SIZES:
+            text = char * size
+            number = max(10, 10 * 1024 * 1024 // size)
+
+            elapsed = timeit.timeit(lambda: length(text), number=number)
+            report("py -> js", name, size, number, elapsed)
+
+            getter = maker(char, size)
+
+            elapsed = timeit.timeit(getter, number=number)
+            report("js -> py", name, size, number, elapsed)
@@ -40,8 +40,14 @@ source_files = [
     "Isolate.cpp",
     "Context.cpp",
     "Engine.cpp",
+    "CodeCache.cpp",
+    "ScriptCache.cpp",
+    "NameCache.cpp",
+    "FunctionCache.cpp",
     "Wrapper.cpp",
     "Locker.cpp",
+    "IsolatePool.cpp",
+    "Profiler.cpp",
     "Utils.cpp",
     "STPyV8.cpp",
 ]
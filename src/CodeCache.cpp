@@ -0,0 +1,300 @@
+#include "CodeCache.h"
+
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include <boost/thread/locks.hpp>
+
+boost::mutex CCodeCache::s_lock;
+
+bool CCodeCache::s_enabled = false;
+boost::filesystem::path CCodeCache::s_directory;
+size_t CCodeCache::s_max_size = CCodeCache::DEFAULT_MAX_SIZE;
+size_t CCodeCache::s_size = 0;
+
+CCodeCache::CEntryList CCodeCache::s_entries;
+CCodeCache::CEntryMap CCodeCache::s_index;
+
+size_t CCodeCache::s_hits = 0;
+size_t CCodeCache::s_misses = 0;
+size_t CCodeCache::s_rejected = 0;
+size_t CCodeCache::s_stores = 0;
+size_t CCodeCache::s_evictions = 0;
+
+const std::string CCodeCache::GetFileName(uint64_t source_hash)
+{
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), "%016llx-%08x.bin",
+             (unsigned long long) source_hash, v8::ScriptCompiler::CachedDataVersionTag());
+
+    return std::string(buf);
+}
+
+void CCodeCache::Enable(const std::string& directory, size_t max_size)
+{
+    boost::lock_guard<boost::mutex> lock(s_lock);
+
+    boost::filesystem::create_directories(directory);
+
+    s_directory = directory;
+    s_max_size = max_size;
+    s_enabled = true;
+
+    Scan();
+    Evict();
+}
+
+void CCodeCache::Disable(void)
+{
+    boost::lock_guard<boost::mutex> lock(s_lock);
+
+    s_enabled = false;
+
+    s_entries.clear();
+    s_index.clear();
+    s_size = 0;
+}
+
+void CCodeCache::Clear(void)
+{
+    boost::lock_guard<boost::mutex> lock(s_lock);
+
+    while (!s_index.empty())
+    {
+        Remove(s_index.begin());
+    }
+}
+
+void CCodeCache::Scan(void)
+{
+    s_entries.clear();
+    s_index.clear();
+    s_size = 0;
+
+    std::vector<std::pair<std::time_t, CEntry> > found;
+
+    boost::system::error_code ec;
+
+    for (boost::filesystem::directory_iterator it(s_directory, ec), end; !ec && it != end; it.increment(ec))
+    {
+        const boost::filesystem::path& path = it->path();
+        boost::system::error_code file_ec;
+
+        if (path.extension() != ".bin" || !boost::filesystem::is_regular_file(path, file_ec))
+            continue;
+
+        CEntry entry = { path, (size_t) boost::filesystem::file_size(path, file_ec) };
+        std::time_t mtime = boost::filesystem::last_write_time(path, file_ec);
+
+        if (!file_ec) found.push_back(std::make_pair(mtime, entry));
+    }
+
+    std::sort(found.begin(), found.end(),
+              [](const std::pair<std::time_t, CEntry>& a, const std::pair<std::time_t, CEntry>& b) {
+                  return a.first > b.first;
+              });
+
+    for (size_t i=0; i<found.size(); i++)
+    {
+        s_entries.push_back(found[i].second);
+        s_index[found[i].second.path.filename().string()] = std::prev(s_entries.end());
+        s_size += found[i].second.size;
+    }
+}
+
+void CCodeCache::Touch(CEntryMap::iterator it)
+{
+    s_entries.splice(s_entries.begin(), s_entries, it->second);
+
+    // keep the on-disk order in sync, so other processes evict the same entries
+    boost::system::error_code ec;
+    boost::filesystem::last_write_time(it->second->path, std::time(NULL), ec);
+}
+
+void CCodeCache::Remove(CEntryMap::iterator it)
+{
+    boost::system::error_code ec;
+    boost::filesystem::remove(it->second->path, ec);
+
+    s_size -= it->second->size;
+    s_entries.erase(it->second);
+    s_index.erase(it);
+}
+
+void CCodeCache::Evict(void)
+{
+    while (s_size > s_max_size && !s_entries.empty())
+    {
+        Remove(s_index.find(s_entries.back().path.filename().string()));
+
+        s_evictions++;
+    }
+}
+
+v8::ScriptCompiler::CachedData *CCodeCache::Load(uint64_t source_hash, const std::string& source)
+{
+    boost::lock_guard<boost::mutex> lock(s_lock);
+
+    if (!s_enabled) return NULL;
+
+    std::string name = GetFileName(source_hash);
+    CEntryMap::iterator it = s_index.find(name);
+
+    if (it == s_index.end())
+    {
+        // the entry may have been stored by another process sharing the directory
+        boost::system::error_code ec;
+        boost::filesystem::path path = s_directory / name;
+        size_t size = (size_t) boost::filesystem::file_size(path, ec);
+
+        if (ec)
+        {
+            s_misses++;
+
+            return NULL;
+        }
+
+        CEntry entry = { path, size };
+
+        s_entries.push_front(entry);
+        it = s_index.insert(std::make_pair(name, s_entries.begin())).first;
+        s_size += size;
+    }
+
+    std::ifstream file(it->second->path.string(), std::ios::in | std::ios::binary);
+
+    uint64_t source_size = 0;
+
+    if (!file.read(reinterpret_cast<char *>(&source_size), sizeof(source_size)) ||
+        it->second->size - sizeof(source_size) <= source_size)
+    {
+        Remove(it);
+
+        s_misses++;
+
+        return NULL;
+    }
+
+    std::string entry_source(source_size, '\0');
+
+    if (source_size != source.size() || !file.read(&entry_source[0], source_size) || entry_source != source)
+    {
+        // another source with the same hash, its entry stays for it
+        s_misses++;
+
+        return NULL;
+    }
+
+    size_t size = it->second->size - sizeof(source_size) - source_size;
+    std::unique_ptr<uint8_t[]> data(new uint8_t[size]);
+
+    if (!file.read(reinterpret_cast<char *>(data.get()), size))
+    {
+        Remove(it);
+
+        s_misses++;
+
+        return NULL;
+    }
+
+    return new v8::ScriptCompiler::CachedData(data.release(), size,
+                                              v8::ScriptCompiler::CachedData::BufferOwned);
+}
+
+void CCodeCache::Consumed(uint64_t source_hash, bool rejected)
+{
+    boost::lock_guard<boost::mutex> lock(s_lock);
+
+    CEntryMap::iterator it = s_index.find(GetFileName(source_hash));
+
+    if (rejected)
+    {
+        s_rejected++;
+
+        if (it != s_index.end()) Remove(it);
+    }
+    else
+    {
+        s_hits++;
+
+        if (it != s_index.end()) Touch(it);
+    }
+}
+
+void CCodeCache::Store(uint64_t source_hash, const std::string& source, const v8::ScriptCompiler::CachedData *data)
+{
+    boost::lock_guard<boost::mutex> lock(s_lock);
+
+    if (!s_enabled || !data || data->length <= 0) return;
+
+    std::string name = GetFileName(source_hash);
+    boost::filesystem::path path = s_directory / name;
+    boost::filesystem::path temp = s_directory / (name + ".tmp");
+
+    uint64_t source_size = source.size();
+
+    {
+        std::ofstream file(temp.string(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+        if (!file.write(reinterpret_cast<const char *>(&source_size), sizeof(source_size)) ||
+            !file.write(source.data(), source.size()) ||
+            !file.write(reinterpret_cast<const char *>(data->data), data->length))
+            return;
+    }
+
+    // rename is atomic, so a concurrent reader never sees a partial entry
+    boost::system::error_code ec;
+    boost::filesystem::rename(temp, path, ec);
+
+    if (ec)
+    {
+        boost::filesystem::remove(temp, ec);
+
+        return;
+    }
+
+    CEntryMap::iterator it = s_index.find(name);
+
+    if (it != s_index.end())
+    {
+        s_size -= it->second->size;
+        s_entries.erase(it->second);
+        s_index.erase(it);
+    }
+
+    CEntry entry = { path, sizeof(source_size) + source.size() + (size_t) data->length };
+
+    s_entries.push_front(entry);
+    s_index[name] = s_entries.begin();
+    s_size += entry.size;
+
+    s_stores++;
+
+    Evict();
+}
+
+py::dict CCodeCache::GetStats(void)
+{
+    boost::lock_guard<boost::mutex> lock(s_lock);
+
+    py::dict stats;
+
+    stats["enabled"] = s_enabled;
+    stats["directory"] = s_directory.string();
+    stats["entries"] = s_entries.size();
+    stats["size"] = s_size;
+    stats["max_size"] = s_max_size;
+    stats["hits"] = s_hits;
+    stats["misses"] = s_misses;
+    stats["rejected"] = s_rejected;
+    stats["stores"] = s_stores;
+    stats["evictions"] = s_evictions;
+
+    return stats;
+}
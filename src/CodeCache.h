@@ -0,0 +1,74 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "Utils.h"
+
+// Persistent on-disk cache of V8 code caches, shared by every isolate of the process.
+//
+// Entries are keyed by the hash of the script source and the V8 cached data version
+// tag (which covers both the V8 version and the current flags), so a V8 upgrade or a
+// flag change never consumes stale data. The hash is not collision resistant, so an
+// entry starts with the source it was compiled from, and is only consumed by the same
+// source. The cache directory is bounded in size and the least recently used entries
+// are evicted first.
+
+class CCodeCache
+{
+    struct CEntry
+    {
+        boost::filesystem::path path;
+        size_t size;
+    };
+
+    typedef std::list<CEntry> CEntryList;
+    typedef std::map<std::string, CEntryList::iterator> CEntryMap;
+
+    static boost::mutex s_lock;
+
+    static bool s_enabled;
+    static boost::filesystem::path s_directory;
+    static size_t s_max_size;
+    static size_t s_size;
+
+    static CEntryList s_entries; // most recently used first
+    static CEntryMap s_index;
+
+    static size_t s_hits;
+    static size_t s_misses;
+    static size_t s_rejected;
+    static size_t s_stores;
+    static size_t s_evictions;
+
+    static const std::string GetFileName(uint64_t source_hash);
+
+    static void Scan(void);
+    static void Touch(CEntryMap::iterator it);
+    static void Remove(CEntryMap::iterator it);
+    static void Evict(void);
+public:
+    static constexpr size_t DEFAULT_MAX_SIZE = 64 * 1024 * 1024;
+
+    static void Enable(const std::string& directory, size_t max_size = DEFAULT_MAX_SIZE);
+    static void Disable(void);
+    static void Clear(void);
+
+    static bool IsEnabled(void) {
+        return s_enabled;
+    }
+
+    // Returns a new cached data owned by the caller, or NULL on a cache miss
+    static v8::ScriptCompiler::CachedData *Load(uint64_t source_hash, const std::string& source);
+
+    // Reports whether V8 accepted or rejected the cached data returned by Load
+    static void Consumed(uint64_t source_hash, bool rejected);
+
+    static void Store(uint64_t source_hash, const std::string& source, const v8::ScriptCompiler::CachedData *data);
+
+    static py::dict GetStats(void);
+};
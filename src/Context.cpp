@@ -1,6 +1,7 @@
 #include "Context.h"
 #include "Wrapper.h"
 #include "Engine.h"
+#include "Profiler.h"
 
 #include "libplatform/libplatform.h"
 
@@ -11,8 +12,20 @@ void CContext::Expose(void)
     .def("init", &CPlatform::Init, "Initializes the platform")
     ;
 
+    py::enum_<CIsolateData::HeapLimitPolicy>("JSHeapLimitPolicy")
+    .value("Grow", CIsolateData::HEAP_LIMIT_GROW)
+    .value("Terminate", CIsolateData::HEAP_LIMIT_TERMINATE)
+    .value("Hook", CIsolateData::HEAP_LIMIT_HOOK)
+    ;
+
     py::class_<CIsolate, boost::noncopyable>("JSIsolate", "JSIsolate is an isolated instance of the V8 engine.", py::no_init)
-    .def(py::init<bool>((py::arg("owner") = false)))
+    .def(py::init<bool, size_t, size_t, size_t, size_t>((py::arg("owner") = false,
+                                                         py::arg("max_old_space") = 0,
+                                                         py::arg("max_young_space") = 0,
+                                                         py::arg("code_range") = 0,
+                                                         py::arg("initial_heap") = 0),
+         "Creates an isolate, whose heap is bounded by the sizes in bytes of its old and young "
+         "generations and of its code range, zero keeping the default of V8."))
 
     .add_static_property("current", &CIsolate::GetCurrent,
                          "Returns the entered isolate for the current thread or NULL in case there is no current isolate.")
@@ -29,6 +42,48 @@ void CContext::Expose(void)
     .def("leave", &CIsolate::Leave,
          "Exits this isolate by restoring the previously entered one in the current thread. "
          "The isolate may still stay the same, if it was entered more than once.")
+
+    .add_property("scriptCacheStats", &CIsolate::GetScriptCacheStats,
+                  "Get the hit rate of the compiled script cache, and the size of the sources it holds.")
+
+    .def("setScriptCacheSize", &CIsolate::SetScriptCacheSize, (py::arg("max_entries")),
+         "Bounds the number of compiled scripts cached by the isolate, zero disables the cache.")
+    .def("clearScriptCache", &CIsolate::ClearScriptCache,
+         "Drops every compiled script cached by the isolate.")
+
+    .add_property("functionCacheStats", &CIsolate::GetFunctionCacheStats,
+                  "Get the size and the hit count of the cache of the Python callables passed to Javascript.")
+
+    .def("heap_statistics", &CIsolate::GetHeapStatistics,
+         "Get the sizes in bytes of the heap of the isolate, its limit and the number of its contexts.")
+    .def("heap_space_statistics", &CIsolate::GetHeapSpaceStatistics,
+         "Get the sizes in bytes of each space of the heap, by space name.")
+    .def("code_statistics", &CIsolate::GetCodeStatistics,
+         "Get the sizes in bytes of the generated code, the bytecode and the script sources.")
+    .def("write_heap_snapshot", &CIsolate::WriteHeapSnapshot, (py::arg("path")),
+         "Writes a heap snapshot to a .heapsnapshot file for the Chrome DevTools, "
+         "where the wrappers of the Python objects are labeled with their type.")
+    .def("start_profiling", &CIsolate::StartProfiling, (py::arg("name"),
+                                                        py::arg("sampling_interval_us") = CIsolate::DEFAULT_SAMPLING_INTERVAL),
+         "Starts sampling the Javascript stacks of the isolate every sampling_interval_us microseconds, "
+         "which is rounded up to a multiple of the interval of the first running profiling.")
+    .def("stop_profiling", &CIsolate::StopProfiling, (py::arg("name")),
+         "Stops the profiling started with the name and returns its JSCpuProfile.")
+    .def("pump_message_loop", &CIsolate::PumpMessageLoop, (py::arg("wait") = false),
+         "Runs a pending task of the isolate, waiting for one when wait is true, "
+         "and returns whether a task was run.")
+
+    .add_property("heapLimitPolicy", &CIsolate::GetHeapLimitPolicy,
+                  "What the isolate does when its heap gets close to its limit.")
+    .def("setHeapLimitPolicy", &CIsolate::SetHeapLimitPolicy,
+         (py::arg("policy"),
+          py::arg("increase") = CIsolateData::DEFAULT_HEAP_INCREASE,
+          py::arg("max_increase") = CIsolateData::DEFAULT_HEAP_MAX_INCREASE,
+          py::arg("hook") = py::object()),
+         "Grow raises the heap limit by increase bytes up to max_increase bytes over the initial limit, "
+         "and V8 aborts when it runs out. Terminate raises it the same way, then ends the running script "
+         "with a JSError. Hook calls hook(current_limit, initial_limit) for the new limit, "
+         "and None ends the script; it runs in the garbage collector and must not use Javascript.")
     ;
 
     py::class_<CContext, boost::noncopyable>("JSContext", "JSContext is an execution context.", py::no_init)
@@ -40,6 +95,16 @@ void CContext::Expose(void)
 
     .add_property("locals", &CContext::GetGlobal, "Local variables within context")
 
+    .def("measure_memory", &CContext::MeasureMemory, (py::arg("callback"),
+                                                      py::arg("eager") = true),
+         "Measures the memory retained by the context and calls back with a dict of sizes in bytes. "
+         "The measurement completes with the tasks run by JSIsolate.pump_message_loop; "
+         "an eager one starts a GC right away, otherwise it waits for the next one.")
+    .def("to_js", &CContext::ToJavascript, (py::arg("obj"),
+                                            py::arg("copy") = true),
+         "Copies the dicts, lists, tuples, strings and numbers of a Python object into native "
+         "Javascript objects and arrays, which Javascript reads without calling back into Python.")
+
     .add_static_property("entered", &CContext::GetEntered,
                          "The last entered context.")
     .add_static_property("current", &CContext::GetCurrent,
@@ -101,12 +166,25 @@ CContext::CContext(py::object global)
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
     v8::HandleScope handle_scope(isolate);
 
-    v8::Handle<v8::Context> context = v8::Context::New(isolate);
+    // rebinds the Python global captured by a startup snapshot, if the isolate was created from one
+    CPythonObject::CDeserializedFields fields = { &global };
+
+    v8::Handle<v8::Context> context = v8::Context::New(isolate, NULL, v8::MaybeLocal<v8::ObjectTemplate>(),
+                                      v8::MaybeLocal<v8::Value>(),
+                                      v8::DeserializeInternalFieldsCallback(CPythonObject::DeserializeInternalField, &fields));
 
     m_context.Reset(isolate, context);
 
     v8::Context::Scope context_scope(Handle());
 
+#ifdef SUPPORT_TRACE_LIFECYCLE
+    // the living objects of the context can only be traced from inside of it
+    for (auto& wrapper : fields.wrappers)
+    {
+        ObjectTracer::Trace(wrapper.first.Get(isolate), wrapper.second);
+    }
+#endif
+
     if (!global.is_none())
     {
         v8::Maybe<bool> retcode =
@@ -128,6 +206,84 @@ py::object CContext::GetGlobal(void)
     return CJavascriptObject::Wrap(Handle()->Global());
 }
 
+py::object CContext::ToJavascript(py::object obj, bool copy)
+{
+    // without a copy, the objects are wrapped when they are passed to Javascript
+    if (!copy) return obj;
+
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+
+    v8::Context::Scope context_scope(Handle());
+
+    return CJavascriptObject::Wrap(CPythonObject::Copy(obj));
+}
+
+namespace {
+
+class CMemoryMeasurement : public v8::MeasureMemoryDelegate
+{
+    v8::Isolate *m_isolate;
+    v8::Global<v8::Context> m_context;
+    py::object m_callback;
+public:
+    CMemoryMeasurement(v8::Isolate *isolate, v8::Local<v8::Context> context, py::object callback)
+        : m_isolate(isolate), m_context(isolate, context), m_callback(callback)
+    {
+    }
+
+    ~CMemoryMeasurement()
+    {
+        CPythonGIL python_gil;
+
+        m_callback = py::object();
+    }
+
+    virtual bool ShouldMeasure(v8::Local<v8::Context> context) override
+    {
+        return m_context == context;
+    }
+
+    virtual void MeasurementComplete(Result result) override
+    {
+        CPythonGIL python_gil;
+
+        py::dict sizes;
+
+        sizes["size"] = result.sizes_in_bytes.size() ? result.sizes_in_bytes[0] : 0;
+        sizes["unattributed_size"] = result.unattributed_size_in_bytes;
+        sizes["wasm_code_size"] = result.wasm_code_size_in_bytes;
+        sizes["wasm_metadata_size"] = result.wasm_metadata_size_in_bytes;
+
+        try
+        {
+            m_callback(sizes);
+        }
+        catch (const py::error_already_set&)
+        {
+            ::PyErr_WriteUnraisable(m_callback.ptr());
+        }
+    }
+};
+
+}
+
+void CContext::MeasureMemory(py::object callback, bool eager)
+{
+    if (!::PyCallable_Check(callback.ptr())) throw CJavascriptException("the callback must be callable", ::PyExc_TypeError);
+
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+
+    std::unique_ptr<v8::MeasureMemoryDelegate> delegate(new CMemoryMeasurement(isolate, Handle(), callback));
+
+    if (!isolate->MeasureMemory(std::move(delegate), eager ? v8::MeasureMemoryExecution::kEager
+                                                           : v8::MeasureMemoryExecution::kDefault))
+    {
+        throw CJavascriptException("fail to measure the memory of the context", ::PyExc_RuntimeError);
+    }
+}
+
 py::str CContext::GetSecurityToken(void)
 {
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
@@ -18,6 +18,7 @@ typedef std::shared_ptr<CIsolate> CIsolatePtr;
 
 class CContext
 {
+    CIsolateRef m_isolate_ref;
     py::object m_global;
     v8::Persistent<v8::Context> m_context;
 public:
@@ -36,6 +37,13 @@ public:
 
     py::object GetGlobal(void);
 
+    // Copies the Python containers into native Javascript objects and arrays of the context
+    py::object ToJavascript(py::object obj, bool copy);
+
+    // Measures the memory of the context in the background, the callback receives the sizes
+    // once the isolate runs the pending tasks following the measurement
+    void MeasureMemory(py::object callback, bool eager);
+
     py::str GetSecurityToken(void);
     void SetSecurityToken(py::str token);
 
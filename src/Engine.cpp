@@ -1,6 +1,10 @@
 #include "Engine.h"
 #include "Exception.h"
 #include "Wrapper.h"
+#include "CodeCache.h"
+#include "ScriptCache.h"
+#include "Isolate.h"
+#include "Context.h"
 
 #include <iostream>
 
@@ -50,6 +54,35 @@ void CEngine::Expose(void)
          "Given a size, returns an address that is that far from the current top of stack.")
     .staticmethod("setStackLimit")
 
+    .def("enableCodeCache", &CCodeCache::Enable, (py::arg("directory"),
+                                                  py::arg("max_size") = CCodeCache::DEFAULT_MAX_SIZE),
+         "Persist the V8 code cache of compiled scripts into a local directory, "
+         "so later compilations of the same source skip parsing and compiling. "
+         "The least recently used entries are evicted once max_size bytes are exceeded.")
+    .staticmethod("enableCodeCache")
+
+    .def("disableCodeCache", &CCodeCache::Disable, "Stop using the persistent code cache.")
+    .staticmethod("disableCodeCache")
+
+    .def("clearCodeCache", &CCodeCache::Clear, "Remove every entry of the persistent code cache.")
+    .staticmethod("clearCodeCache")
+
+    .add_static_property("codeCacheStats", &CCodeCache::GetStats,
+                         "Get the hit, miss, rejection, store and eviction counters of the persistent code cache.")
+
+    .def("serialize", &CEngine::Serialize, (py::arg("source") = std::string(),
+                                            py::arg("global") = py::object()),
+         "Runs the bootstrap source in a fresh context and returns a startup snapshot of that context.")
+    .staticmethod("serialize")
+
+    .def("deserialize", &CEngine::Deserialize, (py::arg("snapshot")),
+         "Creates the isolates from the given startup snapshot, "
+         "so their contexts start with the bootstrap state already initialized.")
+    .staticmethod("deserialize")
+
+    // whether the new isolates are created from the deserialized startup snapshot
+    .add_static_property("serializeEnabled", &CEngine::IsSerializeEnabled, &CEngine::SetSerializeEnable)
+
     /*
         .def("setMemoryAllocationCallback", &MemoryAllocationManager::SetCallback,
                                             (py::arg("callback"),
@@ -73,7 +106,9 @@ void CEngine::Expose(void)
     py::class_<CScript, boost::noncopyable>("JSScript", "JSScript is a compiled JavaScript script.", py::no_init)
     .add_property("source", &CScript::GetSource, "the source code")
 
-    .def("run", &CScript::Run, "Execute the compiled code.")
+    .def("run", &CScript::Run, "Execute the compiled code in the current context.")
+    .def("run", &CScript::RunIn, (py::arg("context")),
+         "Execute the compiled code in the given context of the same isolate.")
     ;
 
     py::objects::class_value_wrapper<std::shared_ptr<CScript>,
@@ -81,6 +116,110 @@ void CEngine::Expose(void)
     py::objects::pointer_holder<std::shared_ptr<CScript>, CScript> > >();
 }
 
+bool CEngine::s_serialize_enabled = false;
+CSnapshotPtr CEngine::s_snapshot;
+
+void CEngine::SetSerializeEnable(bool value)
+{
+    if (value && !s_snapshot)
+        throw CJavascriptException("no snapshot was deserialized", ::PyExc_RuntimeError);
+
+    s_serialize_enabled = value;
+}
+
+bool CEngine::IsSerializeEnabled(void)
+{
+    return s_serialize_enabled;
+}
+
+py::object CEngine::Serialize(const std::string& source, py::object global)
+{
+    std::unique_ptr<v8::ArrayBuffer::Allocator> allocator(v8::ArrayBuffer::Allocator::NewDefaultAllocator());
+
+    v8::Isolate::CreateParams create_params;
+    create_params.array_buffer_allocator = allocator.get();
+    create_params.external_references = CPythonObject::GetExternalReferences();
+
+    v8::StartupData blob = { NULL, 0 };
+    std::string error;
+
+    {
+        v8::SnapshotCreator creator(create_params);
+        v8::Isolate *isolate = creator.GetIsolate();
+
+        {
+            v8::HandleScope handle_scope(isolate);
+            v8::Local<v8::Context> context = v8::Context::New(isolate);
+            v8::Context::Scope context_scope(context);
+
+            v8::TryCatch try_catch(isolate);
+
+            if (!global.is_none())
+            {
+                context->Global()->SetPrototype(context, CPythonObject::Wrap(global)).Check();
+            }
+
+            v8::Local<v8::Script> script;
+
+            if (!v8::Script::Compile(context, ToString(source)).ToLocal(&script) || script->Run(context).IsEmpty())
+            {
+                v8::String::Utf8Value msg(isolate, try_catch.Exception());
+
+                error = *msg ? std::string(*msg, msg.length()) : std::string("snapshot bootstrap failed");
+            }
+
+            // the living object map is a raw pointer, it can't outlive the isolate
+            v8::Local<v8::Private> living = v8::Private::ForApi(isolate, ToString("__living__"));
+
+            context->Global()->DeletePrivate(context, living).Check();
+
+            if (error.empty())
+            {
+                creator.SetDefaultContext(context, v8::SerializeInternalFieldsCallback(
+                    CPythonObject::SerializeInternalField, global.ptr()));
+            }
+        }
+
+        CIsolateData::Dispose(isolate);
+
+        if (error.empty())
+        {
+            blob = creator.CreateBlob(v8::SnapshotCreator::FunctionCodeHandling::kKeep);
+        }
+    }
+
+    if (!error.empty()) throw CJavascriptException(error);
+
+    std::unique_ptr<const char[]> data(blob.data);
+
+    if (!data) throw CJavascriptException("fail to create the snapshot", ::PyExc_RuntimeError);
+
+    return py::object(py::handle<>(::PyBytes_FromStringAndSize(blob.data, blob.raw_size)));
+}
+
+void CEngine::Deserialize(py::object snapshot)
+{
+    char *data = NULL;
+    Py_ssize_t size = 0;
+
+    if (!PyBytes_Check(snapshot.ptr()) || ::PyBytes_AsStringAndSize(snapshot.ptr(), &data, &size) < 0)
+        throw CJavascriptException("snapshot must be a bytes object", ::PyExc_TypeError);
+
+    CSnapshotPtr installed(new CSnapshot());
+
+    installed->data.assign(data, size);
+    installed->blob.data = installed->data.data();
+    installed->blob.raw_size = (int) installed->data.size();
+
+    if (!installed->blob.IsValid())
+        throw CJavascriptException("snapshot was created by another V8 build", ::PyExc_ValueError);
+
+    // contexts are deserialized lazily, so the isolates created from the previous snapshot keep it,
+    // and it is freed once they are all disposed
+    s_snapshot = installed;
+    s_serialize_enabled = true;
+}
+
 bool CEngine::IsDead(void)
 {
     return v8::Isolate::GetCurrent()->IsDead();
@@ -140,36 +279,72 @@ void CEngine::SetStackLimit(uintptr_t stack_limit_size)
 
 std::shared_ptr<CScript> CEngine::InternalCompile(v8::Handle<v8::String> src,
         v8::Handle<v8::Value> name,
-        int line, int col)
+        int line, int col, uint64_t source_hash)
 {
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
     v8::HandleScope handle_scope(isolate);
-    v8::Local<v8::Context> context = isolate->GetCurrentContext();
 
     v8::TryCatch try_catch(isolate);
 
     v8::Persistent<v8::String> script_source(m_isolate, src);
 
-    v8::MaybeLocal<v8::Script> script;
+    v8::MaybeLocal<v8::UnboundScript> script;
     v8::Handle<v8::String> source = v8::Local<v8::String>::New(m_isolate, script_source);
 
-    Py_BEGIN_ALLOW_THREADS
+    CScriptCache& script_cache = CIsolateData::Get(m_isolate)->GetScriptCache();
+
+    v8::Local<v8::UnboundScript> cached_script;
 
-    if (line >= 0 && col >= 0)
+    if (script_cache.Lookup(source, name, line, col, source_hash).ToLocal(&cached_script))
     {
-        v8::ScriptOrigin script_origin(name, line, col);
-        script = v8::Script::Compile(context, source, &script_origin);
+        return std::shared_ptr<CScript>(new CScript(m_isolate, *this, script_source, cached_script));
     }
-    else
+
+    v8::ScriptOrigin script_origin(name, (line >= 0 && col >= 0) ? line : 0, (line >= 0 && col >= 0) ? col : 0);
+
+    // the persistent entries are checked against the source, the hash alone could collide
+    std::string source_text;
+
+    if (CCodeCache::IsEnabled())
     {
-        v8::ScriptOrigin script_origin(name);
-        script = v8::Script::Compile(context, source, &script_origin);
+        v8::String::Utf8Value text(m_isolate, source);
+
+        source_text.assign(*text, text.length());
     }
 
+    v8::ScriptCompiler::CachedData *cached_data = CCodeCache::IsEnabled() ? CCodeCache::Load(source_hash, source_text) : NULL;
+    v8::ScriptCompiler::Source script_source_data(source, script_origin, cached_data);
+
+    Py_BEGIN_ALLOW_THREADS
+
+    script = v8::ScriptCompiler::CompileUnboundScript(m_isolate, &script_source_data,
+             cached_data ? v8::ScriptCompiler::kConsumeCodeCache
+                         : v8::ScriptCompiler::kNoCompileOptions);
+
     Py_END_ALLOW_THREADS
 
     if (script.IsEmpty()) CJavascriptException::ThrowIf(m_isolate, try_catch);
 
+    if (!script.IsEmpty())
+    {
+        script_cache.Insert(source, name, line, col, source_hash, script.ToLocalChecked());
+    }
+
+    if (CCodeCache::IsEnabled() && !script.IsEmpty())
+    {
+        bool rejected = cached_data && script_source_data.GetCachedData()->rejected;
+
+        if (cached_data) CCodeCache::Consumed(source_hash, rejected);
+
+        if (!cached_data || rejected)
+        {
+            std::unique_ptr<v8::ScriptCompiler::CachedData> code_cache(
+                v8::ScriptCompiler::CreateCodeCache(script.ToLocalChecked()));
+
+            CCodeCache::Store(source_hash, source_text, code_cache.get());
+        }
+    }
+
     return std::shared_ptr<CScript>(new CScript(m_isolate, *this, script_source, script.ToLocalChecked()));
 }
 
@@ -179,6 +354,8 @@ py::object CEngine::ExecuteScript(v8::Handle<v8::Script> script)
     v8::HandleScope handle_scope(isolate);
     v8::Local<v8::Context> context = isolate->GetCurrentContext();
 
+    CIsolateData::CheckHeapLimitHook(isolate);
+
     v8::TryCatch try_catch(isolate);
 
     v8::MaybeLocal<v8::Value> result;
@@ -193,6 +370,8 @@ py::object CEngine::ExecuteScript(v8::Handle<v8::Script> script)
     {
         if (try_catch.HasCaught())
         {
+            CJavascriptException::ThrowIfTerminated(m_isolate, try_catch);
+
             if(!try_catch.CanContinue() && PyErr_Occurred())
             {
                 throw py::error_already_set();
@@ -220,5 +399,22 @@ py::object CScript::Run(void)
 {
     v8::HandleScope handle_scope(m_isolate);
 
-    return m_engine.ExecuteScript(Script());
+    if (!m_isolate->InContext())
+        throw CJavascriptException("Javascript script out of context", ::PyExc_UnboundLocalError);
+
+    return m_engine.ExecuteScript(Script()->BindToCurrentContext());
+}
+
+py::object CScript::RunIn(CContext& context)
+{
+    v8::HandleScope handle_scope(m_isolate);
+
+    v8::Handle<v8::Context> ctxt = context.Handle();
+
+    if (ctxt.IsEmpty() || ctxt->GetIsolate() != m_isolate)
+        throw CJavascriptException("context belongs to another isolate", ::PyExc_ValueError);
+
+    v8::Context::Scope context_scope(ctxt);
+
+    return m_engine.ExecuteScript(Script()->BindToCurrentContext());
 }
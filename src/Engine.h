@@ -4,20 +4,36 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <list>
 
 #include "Utils.h"
+#include "Isolate.h"
 
 class CScript;
+class CContext;
 
 typedef std::shared_ptr<CScript> CScriptPtr;
 
+// A startup snapshot installed by JSEngine.deserialize, kept alive by the isolates created from it
+struct CSnapshot
+{
+    std::string data;
+    v8::StartupData blob;
+};
+
+typedef std::shared_ptr<CSnapshot> CSnapshotPtr;
+
 class CEngine
 {
     v8::Isolate *m_isolate;
 
+    static bool s_serialize_enabled;
+    static CSnapshotPtr s_snapshot;
+
     static uintptr_t CalcStackLimitSize(uintptr_t size);
 protected:
-    CScriptPtr InternalCompile(v8::Handle<v8::String> src, v8::Handle<v8::Value> name, int line, int col);
+    CScriptPtr InternalCompile(v8::Handle<v8::String> src, v8::Handle<v8::Value> name, int line, int col,
+                               uint64_t source_hash);
 
     static void TerminateAllThreads(void);
 
@@ -29,17 +45,23 @@ public:
     CScriptPtr Compile(const std::string& src, const std::string name = std::string(),
                        int line = -1, int col = -1)
     {
+        CIsolateData::CheckHeapLimitHook(m_isolate);
+
         v8::HandleScope scope(m_isolate);
 
-        return InternalCompile(ToString(src), ToString(name), line, col);
+        return InternalCompile(ToString(src), ToString(name), line, col,
+                               HashBytes(src.data(), src.size()));
     }
 
     CScriptPtr CompileW(const std::wstring& src, const std::wstring name = std::wstring(),
                         int line = -1, int col = -1)
     {
+        CIsolateData::CheckHeapLimitHook(m_isolate);
+
         v8::HandleScope scope(m_isolate);
 
-        return InternalCompile(ToString(src), ToString(name), line, col);
+        return InternalCompile(ToString(src), ToString(name), line, col,
+                               HashBytes(src.data(), src.size() * sizeof(wchar_t)));
     }
 
     void RaiseError(v8::TryCatch& try_catch);
@@ -61,27 +83,36 @@ public:
     static void SetSerializeEnable(bool value);
     static bool IsSerializeEnabled(void);
 
-    static py::object Serialize(void);
+    // Runs the source in a fresh context and returns the startup snapshot of that context
+    static py::object Serialize(const std::string& source = std::string(), py::object global = py::object());
+    // Installs the startup snapshot used by the isolates created afterwards
     static void Deserialize(py::object snapshot);
+
+    // The snapshot is replaced with the GIL held, so it must be read with the GIL held too
+    static CSnapshotPtr GetSnapshot(void) {
+        return s_serialize_enabled ? s_snapshot : CSnapshotPtr();
+    }
+
     static bool IsDead(void);
 };
 
 class CScript
 {
     v8::Isolate *m_isolate;
+    CIsolateRef m_isolate_ref;
     CEngine& m_engine;
 
     v8::Persistent<v8::String> m_source;
-    v8::Persistent<v8::Script> m_script;
+    v8::Persistent<v8::UnboundScript> m_script;
 public:
-    CScript(v8::Isolate *isolate, CEngine& engine, v8::Persistent<v8::String>& source, v8::Handle<v8::Script> script)
-        : m_isolate(isolate), m_engine(engine), m_source(m_isolate, source), m_script(m_isolate, script)
+    CScript(v8::Isolate *isolate, CEngine& engine, v8::Persistent<v8::String>& source, v8::Handle<v8::UnboundScript> script)
+        : m_isolate(isolate), m_isolate_ref(isolate), m_engine(engine), m_source(m_isolate, source), m_script(m_isolate, script)
     {
 
     }
 
     CScript(const CScript& script)
-        : m_isolate(script.m_isolate), m_engine(script.m_engine)
+        : m_isolate(script.m_isolate), m_isolate_ref(script.m_isolate_ref), m_engine(script.m_engine)
     {
         v8::HandleScope handle_scope(m_isolate);
 
@@ -99,11 +130,13 @@ public:
         return v8::Local<v8::String>::New(m_isolate, m_source);
     }
 
-    v8::Handle<v8::Script> Script() const {
-        return v8::Local<v8::Script>::New(m_isolate, m_script);
+    // The compiled script is not bound to any context, bind it before running it
+    v8::Handle<v8::UnboundScript> Script() const {
+        return v8::Local<v8::UnboundScript>::New(m_isolate, m_script);
     }
 
     const std::string GetSource(void) const;
 
     py::object Run(void);
+    py::object RunIn(CContext& context);
 };
@@ -1,6 +1,7 @@
 #include <sstream>
 
 #include "Exception.h"
+#include "Isolate.h"
 
 std::ostream& operator<<(std::ostream& os, const CJavascriptException& ex)
 {
@@ -328,8 +329,29 @@ static struct {
     { "TypeError",      ::PyExc_TypeError }
 };
 
+void CJavascriptException::ThrowIfTerminated(v8::Isolate *isolate, v8::TryCatch& try_catch)
+{
+    if (!try_catch.HasTerminated()) return;
+
+    v8::HandleScope handle_scope(isolate);
+
+    // a nested entry, called back from a script, lets the termination unwind the outer frames,
+    // or the script could catch the error and go on allocating
+    if (v8::StackTrace::CurrentStackTrace(isolate, 1)->GetFrameCount() > 0) return;
+
+    if (CIsolateData::Get(isolate)->ClearHeapLimitExceeded())
+    {
+        // terminated by the near heap limit policy, the isolate can run the next script
+        isolate->CancelTerminateExecution();
+
+        throw CJavascriptException("heap limit exceeded");
+    }
+}
+
 void CJavascriptException::ThrowIf(v8::Isolate *isolate, v8::TryCatch& try_catch)
 {
+    ThrowIfTerminated(isolate, try_catch);
+
     if (try_catch.HasCaught() && try_catch.CanContinue())
     {
         v8::HandleScope handle_scope(isolate);
@@ -36,16 +36,17 @@ typedef std::shared_ptr<CJavascriptStackFrame> CJavascriptStackFramePtr;
 class CJavascriptStackTrace
 {
     v8::Isolate *m_isolate;
+    CIsolateRef m_isolate_ref;
     v8::Persistent<v8::StackTrace> m_st;
 public:
     CJavascriptStackTrace(v8::Isolate *isolate, v8::Handle<v8::StackTrace> st)
-        : m_isolate(isolate), m_st(isolate, st)
+        : m_isolate(isolate), m_isolate_ref(isolate), m_st(isolate, st)
     {
 
     }
 
     CJavascriptStackTrace(const CJavascriptStackTrace& st)
-        : m_isolate(st.m_isolate)
+        : m_isolate(st.m_isolate), m_isolate_ref(st.m_isolate_ref)
     {
         v8::HandleScope handle_scope(m_isolate);
 
@@ -104,16 +105,17 @@ public:
 class CJavascriptStackFrame
 {
     v8::Isolate *m_isolate;
+    CIsolateRef m_isolate_ref;
     v8::Persistent<v8::StackFrame> m_frame;
 public:
     CJavascriptStackFrame(v8::Isolate *isolate, v8::Handle<v8::StackFrame> frame)
-        : m_isolate(isolate), m_frame(isolate, frame)
+        : m_isolate(isolate), m_isolate_ref(isolate), m_frame(isolate, frame)
     {
 
     }
 
     CJavascriptStackFrame(const CJavascriptStackFrame& frame)
-        : m_isolate(frame.m_isolate)
+        : m_isolate(frame.m_isolate), m_isolate_ref(frame.m_isolate_ref)
     {
         v8::HandleScope handle_scope(m_isolate);
 
@@ -151,6 +153,7 @@ public:
 class CJavascriptException : public std::runtime_error
 {
     v8::Isolate *m_isolate;
+    CIsolateRef m_isolate_ref;
     PyObject *m_type;
 
     v8::Persistent<v8::Value> m_exc, m_stack;
@@ -161,7 +164,7 @@ class CJavascriptException : public std::runtime_error
     static const std::string Extract(v8::Isolate *isolate, v8::TryCatch& try_catch);
 protected:
     CJavascriptException(v8::Isolate *isolate, v8::TryCatch& try_catch, PyObject *type)
-        : std::runtime_error(Extract(isolate, try_catch)), m_isolate(isolate), m_type(type)
+        : std::runtime_error(Extract(isolate, try_catch)), m_isolate(isolate), m_isolate_ref(isolate), m_type(type)
     {
         v8::HandleScope handle_scope(m_isolate);
 
@@ -176,12 +179,12 @@ protected:
     }
 public:
     CJavascriptException(const std::string& msg, PyObject *type = NULL)
-        : std::runtime_error(msg), m_isolate(v8::Isolate::GetCurrent()), m_type(type)
+        : std::runtime_error(msg), m_isolate(v8::Isolate::GetCurrent()), m_isolate_ref(NULL), m_type(type)
     {
     }
 
     CJavascriptException(const CJavascriptException& ex)
-        : std::runtime_error(ex.what()), m_isolate(ex.m_isolate), m_type(ex.m_type)
+        : std::runtime_error(ex.what()), m_isolate(ex.m_isolate), m_isolate_ref(ex.m_isolate_ref), m_type(ex.m_type)
     {
         v8::HandleScope handle_scope(m_isolate);
 
@@ -222,6 +225,8 @@ public:
     void PrintCallStack(py::object file);
 
     static void ThrowIf(v8::Isolate *isolate, v8::TryCatch& try_catch);
+    // Ends a termination of the heap limit policy when no Javascript frame is left to unwind
+    static void ThrowIfTerminated(v8::Isolate *isolate, v8::TryCatch& try_catch);
 
     static void Expose(void);
 };
@@ -0,0 +1,128 @@
+#include "FunctionCache.h"
+
+#include "Wrapper.h"
+
+CFunctionCache::~CFunctionCache(void)
+{
+    CPythonGIL python_gil;
+
+    for (CEntryMap::iterator it = m_index.begin(); it != m_index.end(); it++)
+    {
+        delete it->second;
+    }
+
+    m_index.clear();
+    m_tags.clear();
+}
+
+v8::MaybeLocal<v8::Function> CFunctionCache::Get(py::object callable)
+{
+    v8::EscapableHandleScope handle_scope(m_isolate);
+
+    v8::Local<v8::Context> context = m_isolate->GetCurrentContext();
+
+    PyObject *obj = callable.ptr();
+    CKey key = PyMethod_Check(obj) ? std::make_pair(PyMethod_GET_FUNCTION(obj), PyMethod_GET_SELF(obj))
+                                   : std::make_pair(obj, static_cast<PyObject *>(NULL));
+
+    std::pair<CEntryMap::iterator, CEntryMap::iterator> range = m_index.equal_range(key);
+
+    for (CEntryMap::iterator it = range.first; it != range.second; it++)
+    {
+        if (it->second->context == context && !it->second->func.IsEmpty())
+        {
+            m_hits++;
+
+            return handle_scope.Escape(it->second->func.Get(m_isolate));
+        }
+    }
+
+    m_misses++;
+
+    v8::Local<v8::Symbol> tag = v8::Symbol::New(m_isolate);
+    v8::Local<v8::Function> func;
+
+    if (!CPythonObject::CreateFunction(m_isolate, callable, tag).ToLocal(&func))
+        return v8::MaybeLocal<v8::Function>();
+
+    CEntry *entry = new CEntry();
+
+    entry->cache = this;
+    entry->key = key;
+    entry->callable = callable;
+    entry->tag.Reset(m_isolate, tag);
+    entry->hash = tag->GetIdentityHash();
+    entry->func.Reset(m_isolate, func);
+    entry->func.SetWeak(entry, WeakCallback, v8::WeakCallbackType::kParameter);
+    entry->context.Reset(m_isolate, context);
+    entry->context.SetWeak();
+
+    m_index.insert(std::make_pair(key, entry));
+    m_tags.insert(std::make_pair(entry->hash, entry));
+
+    return handle_scope.Escape(func);
+}
+
+void CFunctionCache::Remove(CEntry *entry)
+{
+    std::pair<CEntryMap::iterator, CEntryMap::iterator> range = m_index.equal_range(entry->key);
+
+    for (CEntryMap::iterator it = range.first; it != range.second; it++)
+    {
+        if (it->second == entry)
+        {
+            m_index.erase(it);
+            break;
+        }
+    }
+
+    std::pair<CTagMap::iterator, CTagMap::iterator> tags = m_tags.equal_range(entry->hash);
+
+    for (CTagMap::iterator it = tags.first; it != tags.second; it++)
+    {
+        if (it->second == entry)
+        {
+            m_tags.erase(it);
+            break;
+        }
+    }
+
+    delete entry;
+}
+
+void CFunctionCache::WeakCallback(const v8::WeakCallbackInfo<CEntry>& info)
+{
+    CPythonGIL python_gil;
+
+    CEntry *entry = info.GetParameter();
+
+    entry->func.Reset();
+    entry->cache->Remove(entry);
+}
+
+const CFunctionCache::CEntry *CFunctionCache::Find(v8::Local<v8::Value> data) const
+{
+    if (data.IsEmpty() || !data->IsSymbol()) return NULL;
+
+    v8::Local<v8::Symbol> tag = data.As<v8::Symbol>();
+
+    std::pair<CTagMap::const_iterator, CTagMap::const_iterator> range = m_tags.equal_range(tag->GetIdentityHash());
+
+    for (CTagMap::const_iterator it = range.first; it != range.second; it++)
+    {
+        if (it->second->tag == tag) return it->second;
+    }
+
+    return NULL;
+}
+
+py::dict CFunctionCache::GetStats(void) const
+{
+    py::dict stats;
+
+    stats["entries"] = m_index.size();
+    stats["hits"] = m_hits;
+    stats["misses"] = m_misses;
+
+    return stats;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <map>
+#include <unordered_map>
+
+#include "Utils.h"
+
+// Registry of the Javascript functions of the Python callables passed to Javascript.
+//
+// A callable is keyed by its identity, and a bound method by its __func__ and __self__, so the
+// same Python function or method always maps to the same Javascript function in a context, even
+// though a new bound method is created on each attribute access. The functions are built without
+// a template, which V8 would never collect, and an entry holds its callable only until its
+// function is collected.
+//
+// The data of a function is a symbol tagging its entry instead of a wrapper object, so a function
+// restored from a startup snapshot can't be mistaken for a callable of the new isolate.
+
+class CFunctionCache
+{
+    typedef std::pair<PyObject *, PyObject *> CKey;
+public:
+    struct CEntry
+    {
+        CFunctionCache *cache;
+        CKey key;
+
+        py::object callable; // the bound method itself, so it is called with its receiver
+
+        v8::Global<v8::Symbol> tag;
+        int hash; // the identity hash of the tag
+        v8::Global<v8::Function> func;   // weak, the entry is removed when it is collected
+        v8::Global<v8::Context> context; // weak
+    };
+private:
+    typedef std::multimap<CKey, CEntry *> CEntryMap;
+    typedef std::unordered_multimap<int, CEntry *> CTagMap;
+
+    v8::Isolate *m_isolate;
+
+    CEntryMap m_index;
+    CTagMap m_tags;
+
+    size_t m_hits;
+    size_t m_misses;
+
+    void Remove(CEntry *entry);
+
+    static void WeakCallback(const v8::WeakCallbackInfo<CEntry>& info);
+public:
+    CFunctionCache(v8::Isolate *isolate) : m_isolate(isolate), m_hits(0), m_misses(0) {}
+    ~CFunctionCache(void);
+
+    // Returns the function of a callable in the current context, building it on the first use
+    v8::MaybeLocal<v8::Function> Get(py::object callable);
+
+    // Returns the entry tagged by the data of a function, or NULL if it isn't one of this isolate
+    const CEntry *Find(v8::Local<v8::Value> data) const;
+
+    py::dict GetStats(void) const;
+};
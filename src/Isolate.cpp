@@ -1,40 +1,226 @@
 #include "Context.h"
 #include "Wrapper.h"
 #include "Engine.h"
+#include "ScriptCache.h"
+#include "NameCache.h"
+#include "FunctionCache.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 
 #include "libplatform/libplatform.h"
 
+CIsolateData::CIsolateData(v8::Isolate *isolate)
+    : m_isolate(isolate), m_script_cache(new CScriptCache(isolate)), m_name_cache(new CNameCache(isolate)),
+      m_function_cache(new CFunctionCache(isolate)), m_heap_limit_policy(HEAP_LIMIT_GROW),
+      m_heap_increase(DEFAULT_HEAP_INCREASE), m_heap_max_increase(DEFAULT_HEAP_MAX_INCREASE),
+      m_heap_limit_exceeded(false), m_in_heap_limit_hook(false), m_cpu_profiler(NULL)
+{
+}
+
+CIsolateData::~CIsolateData(void)
+{
+    CPythonGIL python_gil;
+
+    m_type_templates.clear();
+    m_heap_limit_hook = py::object();
+
+    if (m_cpu_profiler) m_cpu_profiler->Dispose();
+}
+
+CIsolateData *CIsolateData::Get(v8::Isolate *isolate)
+{
+    CIsolateData *data = static_cast<CIsolateData *>(isolate->GetData(SLOT));
+
+    if (!data)
+    {
+        data = new CIsolateData(isolate);
+
+        isolate->SetData(SLOT, data);
+    }
+
+    return data;
+}
+
+v8::Local<v8::ObjectTemplate> CIsolateData::GetSharedTemplate(int flags)
+{
+    v8::Global<v8::ObjectTemplate>& clazz = m_shared_templates[flags];
+
+    if (clazz.IsEmpty())
+    {
+        clazz.Reset(m_isolate, CPythonObject::CreateObjectTemplate(m_isolate, flags));
+    }
+
+    return clazz.Get(m_isolate);
+}
+
+v8::Local<v8::ObjectTemplate> CIsolateData::GetWrapperTemplate(PyTypeObject *type)
+{
+    std::unordered_map<PyTypeObject *, CTypeTemplate>::iterator it = m_type_templates.find(type);
+
+    if (it != m_type_templates.end()) return it->second.clazz.Get(m_isolate);
+
+    int flags = CPythonObject::GetTypeFlags(type);
+
+    if (m_type_templates.size() >= MAX_TYPE_TEMPLATES) return GetSharedTemplate(flags);
+
+    // a template of its own gives the instances of the type a stable map
+    CTypeTemplate& entry = m_type_templates[type];
+
+    entry.type = py::object(py::handle<>(py::borrowed(reinterpret_cast<PyObject *>(type))));
+    entry.clazz.Reset(m_isolate, CPythonObject::CreateObjectTemplate(m_isolate, flags));
+
+    return entry.clazz.Get(m_isolate);
+}
+
+void CIsolateData::CheckHeapLimitHook(v8::Isolate *isolate)
+{
+    CIsolateData *data = Find(isolate);
+
+    if (data && data->m_in_heap_limit_hook)
+        throw CJavascriptException("Javascript can't be used by the heap limit hook", ::PyExc_RuntimeError);
+}
+
+CIsolateData *CIsolateData::Find(v8::Isolate *isolate)
+{
+    return static_cast<CIsolateData *>(isolate->GetData(SLOT));
+}
+
+void CIsolateData::Dispose(v8::Isolate *isolate)
+{
+    delete static_cast<CIsolateData *>(isolate->GetData(SLOT));
+
+    isolate->SetData(SLOT, NULL);
+}
+
+void CIsolateData::SetHeapLimitPolicy(HeapLimitPolicy policy, size_t increase, size_t max_increase, py::object hook)
+{
+    if (policy == HEAP_LIMIT_HOOK && !::PyCallable_Check(hook.ptr()))
+    {
+        throw CJavascriptException("the hook policy needs a callable hook", ::PyExc_TypeError);
+    }
+
+    m_heap_limit_policy = policy;
+    m_heap_increase = increase;
+    m_heap_max_increase = max_increase;
+    m_heap_limit_hook = policy == HEAP_LIMIT_HOOK ? hook : py::object();
+}
+
+size_t CIsolateData::OnNearHeapLimit(size_t current_heap_limit, size_t initial_heap_limit)
+{
+    size_t heap_limit = current_heap_limit;
+
+    if (m_heap_limit_policy == HEAP_LIMIT_HOOK)
+    {
+        CPythonGIL python_gil;
+
+        m_in_heap_limit_hook = true;
+
+        try
+        {
+            py::object result = m_heap_limit_hook(current_heap_limit, initial_heap_limit);
+
+            if (!result.is_none()) heap_limit = py::extract<size_t>(result);
+        }
+        catch (const py::error_already_set&)
+        {
+            // the script is terminated, as if the hook gave up
+            ::PyErr_WriteUnraisable(m_heap_limit_hook.ptr());
+        }
+
+        m_in_heap_limit_hook = false;
+    }
+    else if (current_heap_limit + m_heap_increase - initial_heap_limit <= m_heap_max_increase)
+    {
+        heap_limit = current_heap_limit + m_heap_increase;
+    }
+
+    if (heap_limit > current_heap_limit || m_heap_limit_policy == HEAP_LIMIT_GROW) return heap_limit;
+
+    // the script is terminated, with one more step over the policy limit to unwind its stack,
+    // which it doesn't get again while it is still unwinding
+    size_t unwind_limit = initial_heap_limit + m_heap_max_increase + m_heap_increase;
+
+    if (!m_heap_limit_exceeded && current_heap_limit >= unwind_limit)
+    {
+        // a hook raised the limit over the policy one
+        unwind_limit = current_heap_limit + m_heap_increase;
+    }
+
+    m_heap_limit_exceeded = true;
+
+    m_isolate->TerminateExecution();
+
+    return std::max(current_heap_limit, unwind_limit);
+}
 
 size_t CIsolate::NearHeapLimitCallback(void *data,
                                        size_t current_heap_limit, size_t initial_heap_limit)
 {
     v8::Isolate *isolate = (v8::Isolate *)data;
 
-    if (current_heap_limit - initial_heap_limit > heap_max_increase)
-        return current_heap_limit;
-
-    isolate->AdjustAmountOfExternalAllocatedMemory(heap_increase);
-    return current_heap_limit + heap_increase;
+    return CIsolateData::Get(isolate)->OnNearHeapLimit(current_heap_limit, initial_heap_limit);
 }
 
-void CIsolate::Init(bool owner)
+void CIsolate::Init(bool owner, std::shared_ptr<CSnapshot> snapshot, const v8::ResourceConstraints *constraints)
 {
     m_owner = owner;
 
     v8::Isolate::CreateParams create_params;
     create_params.array_buffer_allocator = v8::ArrayBuffer::Allocator::NewDefaultAllocator();
+
+    if (constraints) create_params.constraints = *constraints;
+
+    m_snapshot = snapshot;
+
+    if (m_snapshot)
+    {
+        create_params.snapshot_blob = &m_snapshot->blob;
+        create_params.external_references = CPythonObject::GetExternalReferences();
+
+        // an isolate which is never disposed keeps deserializing its contexts from the snapshot
+        if (!owner) new CSnapshotPtr(m_snapshot);
+    }
     m_isolate = v8::Isolate::New(create_params);
     m_isolate->AddNearHeapLimitCallback(NearHeapLimitCallback, m_isolate);
+
+    // the heap grown by the policy shrinks back once a GC freed the memory
+    m_isolate->AutomaticallyRestoreInitialHeapLimit();
 }
 
 CIsolate::CIsolate(bool owner)
 {
-    CIsolate::Init(owner);
+    CIsolate::Init(owner, CEngine::GetSnapshot());
+}
+
+CIsolate::CIsolate(bool owner, std::shared_ptr<CSnapshot> snapshot)
+{
+    CIsolate::Init(owner, snapshot);
+}
+
+CIsolate::CIsolate(bool owner, size_t max_old_space, size_t max_young_space, size_t code_range, size_t initial_heap)
+{
+    if (max_old_space && initial_heap > max_old_space)
+    {
+        throw CJavascriptException("the initial heap can't be larger than the old space", ::PyExc_ValueError);
+    }
+
+    // the limits can only be set when the isolate is created
+    v8::ResourceConstraints constraints;
+
+    if (max_old_space) constraints.set_max_old_generation_size_in_bytes(max_old_space);
+    if (max_young_space) constraints.set_max_young_generation_size_in_bytes(max_young_space);
+    if (code_range) constraints.set_code_range_size_in_bytes(code_range);
+    if (initial_heap) constraints.set_initial_old_generation_size_in_bytes(initial_heap);
+
+    CIsolate::Init(owner, CEngine::GetSnapshot(), &constraints);
 }
 
 CIsolate::CIsolate()
 {
-    CIsolate::Init(false);
+    CIsolate::Init(false, CEngine::GetSnapshot());
 }
 
 CIsolate::CIsolate(v8::Isolate *isolate) : m_isolate(isolate), m_owner(false)
@@ -43,7 +229,7 @@ CIsolate::CIsolate(v8::Isolate *isolate) : m_isolate(isolate), m_owner(false)
 
 CIsolate::~CIsolate(void)
 {
-    if (m_owner) m_isolate->Dispose();
+    if (m_owner) Dispose();
 }
 
 v8::Isolate *CIsolate::GetIsolate(void)
@@ -51,6 +237,237 @@ v8::Isolate *CIsolate::GetIsolate(void)
     return m_isolate;
 }
 
+py::dict CIsolate::GetScriptCacheStats(void)
+{
+    return CIsolateData::Get(m_isolate)->GetScriptCache().GetStats();
+}
+
+void CIsolate::SetScriptCacheSize(size_t max_entries)
+{
+    CIsolateData::Get(m_isolate)->GetScriptCache().SetMaxEntries(max_entries);
+}
+
+void CIsolate::ClearScriptCache(void)
+{
+    CIsolateData::Get(m_isolate)->GetScriptCache().Clear();
+}
+
+py::dict CIsolate::GetFunctionCacheStats(void)
+{
+    return CIsolateData::Get(m_isolate)->GetFunctionCache().GetStats();
+}
+
+void CIsolate::SetHeapLimitPolicy(CIsolateData::HeapLimitPolicy policy, size_t increase, size_t max_increase, py::object hook)
+{
+    CIsolateData::Get(m_isolate)->SetHeapLimitPolicy(policy, increase, max_increase, hook);
+}
+
+CIsolateData::HeapLimitPolicy CIsolate::GetHeapLimitPolicy(void)
+{
+    return CIsolateData::Get(m_isolate)->GetHeapLimitPolicy();
+}
+
+py::dict CIsolate::GetHeapStatistics(void)
+{
+    v8::HeapStatistics heap_stats;
+
+    m_isolate->GetHeapStatistics(&heap_stats);
+
+    py::dict stats;
+
+    stats["total_heap_size"] = heap_stats.total_heap_size();
+    stats["total_heap_size_executable"] = heap_stats.total_heap_size_executable();
+    stats["total_physical_size"] = heap_stats.total_physical_size();
+    stats["total_available_size"] = heap_stats.total_available_size();
+    stats["used_heap_size"] = heap_stats.used_heap_size();
+    stats["heap_size_limit"] = heap_stats.heap_size_limit();
+    stats["malloced_memory"] = heap_stats.malloced_memory();
+    stats["external_memory"] = heap_stats.external_memory();
+    stats["peak_malloced_memory"] = heap_stats.peak_malloced_memory();
+    stats["number_of_native_contexts"] = heap_stats.number_of_native_contexts();
+    stats["number_of_detached_contexts"] = heap_stats.number_of_detached_contexts();
+    stats["total_global_handles_size"] = heap_stats.total_global_handles_size();
+    stats["used_global_handles_size"] = heap_stats.used_global_handles_size();
+
+    return stats;
+}
+
+py::dict CIsolate::GetHeapSpaceStatistics(void)
+{
+    py::dict spaces;
+
+    for (size_t i=0; i<m_isolate->NumberOfHeapSpaces(); i++)
+    {
+        v8::HeapSpaceStatistics space_stats;
+
+        if (!m_isolate->GetHeapSpaceStatistics(&space_stats, i)) continue;
+
+        py::dict stats;
+
+        stats["space_size"] = space_stats.space_size();
+        stats["space_used_size"] = space_stats.space_used_size();
+        stats["space_available_size"] = space_stats.space_available_size();
+        stats["physical_space_size"] = space_stats.physical_space_size();
+
+        spaces[space_stats.space_name()] = stats;
+    }
+
+    return spaces;
+}
+
+py::dict CIsolate::GetCodeStatistics(void)
+{
+    v8::HeapCodeStatistics code_stats;
+
+    py::dict stats;
+
+    if (!m_isolate->GetHeapCodeAndMetadataStatistics(&code_stats)) return stats;
+
+    stats["code_and_metadata_size"] = code_stats.code_and_metadata_size();
+    stats["bytecode_and_metadata_size"] = code_stats.bytecode_and_metadata_size();
+    stats["external_script_source_size"] = code_stats.external_script_source_size();
+    stats["cpu_profiler_metadata_size"] = code_stats.cpu_profiler_metadata_size();
+
+    return stats;
+}
+
+bool CIsolate::PumpMessageLoop(bool wait)
+{
+    bool pumped = false;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    pumped = v8::platform::PumpMessageLoop(CPlatform::GetPlatform(), m_isolate,
+                                           wait ? v8::platform::MessageLoopBehavior::kWaitForWork
+                                                : v8::platform::MessageLoopBehavior::kDoNotWait);
+
+    Py_END_ALLOW_THREADS
+
+    return pumped;
+}
+
+namespace {
+
+class CFileOutputStream : public v8::OutputStream
+{
+    std::ofstream& m_file;
+public:
+    CFileOutputStream(std::ofstream& file) : m_file(file) {}
+
+    virtual int GetChunkSize() override {
+        return 64 * 1024;
+    }
+
+    virtual WriteResult WriteAsciiChunk(char *data, int size) override {
+        m_file.write(data, size);
+
+        return m_file ? kContinue : kAbort;
+    }
+
+    virtual void EndOfStream() override {}
+};
+
+}
+
+void CIsolate::WriteHeapSnapshot(const std::string& path)
+{
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!file) throw CJavascriptException("fail to open the heap snapshot file " + path, ::PyExc_OSError);
+
+    v8::HandleScope handle_scope(m_isolate);
+
+    v8::HeapProfiler *profiler = m_isolate->GetHeapProfiler();
+
+#ifdef SUPPORT_TRACE_LIFECYCLE
+    profiler->AddBuildEmbedderGraphCallback(ContextTracer::BuildEmbedderGraph, NULL);
+#endif
+
+    const v8::HeapSnapshot *snapshot = profiler->TakeHeapSnapshot();
+
+#ifdef SUPPORT_TRACE_LIFECYCLE
+    profiler->RemoveBuildEmbedderGraphCallback(ContextTracer::BuildEmbedderGraph, NULL);
+#endif
+
+    if (!snapshot) throw CJavascriptException("fail to take the heap snapshot", ::PyExc_RuntimeError);
+
+    CFileOutputStream stream(file);
+
+    snapshot->Serialize(&stream, v8::HeapSnapshot::kJSON);
+
+    const_cast<v8::HeapSnapshot *>(snapshot)->Delete();
+
+    file.close();
+
+    if (!file) throw CJavascriptException("fail to write the heap snapshot file " + path, ::PyExc_OSError);
+}
+
+void CIsolateData::StartProfiling(const std::string& title, int sampling_interval)
+{
+    if (m_profilings.count(title)) throw CJavascriptException("the profiling " + title + " is already started", ::PyExc_ValueError);
+
+    if (!m_cpu_profiler) m_cpu_profiler = v8::CpuProfiler::New(m_isolate);
+
+    // the interval of a profiling is rounded up to a multiple of the one of the profiler,
+    // which can only be changed while nothing is profiled
+    if (m_profilings.empty()) m_cpu_profiler->SetSamplingInterval(sampling_interval);
+
+    v8::HandleScope handle_scope(m_isolate);
+
+    v8::Local<v8::String> name = v8::String::NewFromUtf8(m_isolate, title.c_str(), v8::NewStringType::kNormal, title.size()).ToLocalChecked();
+
+    v8::CpuProfilingStatus status = m_cpu_profiler->StartProfiling(name, v8::CpuProfilingOptions(
+                                        v8::kLeafNodeLineNumbers, v8::CpuProfilingOptions::kNoSampleLimit, sampling_interval));
+
+    if (status == v8::CpuProfilingStatus::kErrorTooManyProfilers) throw CJavascriptException("too many profilings are running", ::PyExc_RuntimeError);
+
+    CProfiling profiling = { sampling_interval, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch()).count() };
+
+    m_profilings[title] = profiling;
+}
+
+CCpuProfilePtr CIsolateData::StopProfiling(const std::string& title)
+{
+    std::map<std::string, CProfiling>::iterator it = m_profilings.find(title);
+
+    if (it == m_profilings.end()) return CCpuProfilePtr();
+
+    CProfiling profiling = it->second;
+
+    m_profilings.erase(it);
+
+    v8::HandleScope handle_scope(m_isolate);
+
+    v8::Local<v8::String> name = v8::String::NewFromUtf8(m_isolate, title.c_str(), v8::NewStringType::kNormal, title.size()).ToLocalChecked();
+
+    v8::CpuProfile *profile = m_cpu_profiler->StopProfiling(name);
+
+    if (!profile) return CCpuProfilePtr();
+
+    CCpuProfilePtr result(new CCpuProfile(title, profile, profiling.sampling_interval, profiling.wall_time));
+
+    profile->Delete();
+
+    return result;
+}
+
+void CIsolate::StartProfiling(const std::string& name, int sampling_interval_us)
+{
+    if (sampling_interval_us <= 0) throw CJavascriptException("the sampling interval must be positive", ::PyExc_ValueError);
+
+    CIsolateData::Get(m_isolate)->StartProfiling(name, sampling_interval_us);
+}
+
+CCpuProfilePtr CIsolate::StopProfiling(const std::string& name)
+{
+    CCpuProfilePtr profile = CIsolateData::Get(m_isolate)->StopProfiling(name);
+
+    if (!profile) throw CJavascriptException("no profiling " + name + " is running", ::PyExc_ValueError);
+
+    return profile;
+}
+
 CJavascriptStackTracePtr CIsolate::GetCurrentStackTrace(int frame_limit,
         v8::StackTrace::StackTraceOptions options = v8::StackTrace::kOverview)
 {
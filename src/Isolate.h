@@ -1,23 +1,148 @@
 #pragma once
 
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
 #include <v8.h> 
 
 #include "Exception.h"
 
+class CScriptCache;
+class CNameCache;
+class CFunctionCache;
+class ContextTracer;
+class CCpuProfile;
+struct CSnapshot;
+
+typedef std::shared_ptr<CCpuProfile> CCpuProfilePtr;
+
+namespace v8 {
+class CpuProfiler;
+}
+
+// Wrapper state shared by everything running in an isolate, kept in its data slot
+class CIsolateData
+{
+    static const uint32_t SLOT = 0;
+
+    v8::Isolate *m_isolate;
+
+    std::unique_ptr<CScriptCache> m_script_cache;
+    std::unique_ptr<CNameCache> m_name_cache;
+    std::unique_ptr<CFunctionCache> m_function_cache;
+
+    struct CTypeTemplate
+    {
+        py::object type; // keeps the type alive, so its address is not reused
+        v8::Global<v8::ObjectTemplate> clazz;
+    };
+
+    // at most MAX_TYPE_TEMPLATES types get their own template, the others share one per capability set
+    static const size_t MAX_TYPE_TEMPLATES = 1024;
+
+    std::unordered_map<PyTypeObject *, CTypeTemplate> m_type_templates;
+    std::unordered_map<int, v8::Global<v8::ObjectTemplate> > m_shared_templates;
+
+    v8::Local<v8::ObjectTemplate> GetSharedTemplate(int flags);
+
+    // the contexts holding wrapped Python objects, whose wrappers are labeled in the heap snapshots
+    std::unordered_set<ContextTracer *> m_context_tracers;
+
+    int m_heap_limit_policy;
+    size_t m_heap_increase;
+    size_t m_heap_max_increase;
+    py::object m_heap_limit_hook;
+    bool m_heap_limit_exceeded;
+    bool m_in_heap_limit_hook;
+
+    struct CProfiling
+    {
+        int sampling_interval; // microseconds
+        int64_t wall_time;     // nanoseconds since the epoch
+    };
+
+    // the CPU profiler is created by the first profiling, and keeps running ones by their title
+    v8::CpuProfiler *m_cpu_profiler;
+    std::map<std::string, CProfiling> m_profilings;
+
+    CIsolateData(v8::Isolate *isolate);
+public:
+    ~CIsolateData(void);
+
+    // What the isolate does when its heap gets close to its limit
+    enum HeapLimitPolicy
+    {
+        HEAP_LIMIT_GROW,      // raise the limit by steps, until V8 aborts on out of memory
+        HEAP_LIMIT_TERMINATE, // raise the limit by steps, then terminate the running script
+        HEAP_LIMIT_HOOK       // ask a Python callable for the new limit, terminate on None
+    };
+
+    static constexpr size_t DEFAULT_HEAP_INCREASE = 8 * 1024 * 1024;
+    static constexpr size_t DEFAULT_HEAP_MAX_INCREASE = 64 * 1024 * 1024;
+
+    void SetHeapLimitPolicy(HeapLimitPolicy policy, size_t increase, size_t max_increase, py::object hook);
+    HeapLimitPolicy GetHeapLimitPolicy(void) const {
+        return static_cast<HeapLimitPolicy>(m_heap_limit_policy);
+    }
+
+    size_t OnNearHeapLimit(size_t current_heap_limit, size_t initial_heap_limit);
+
+    // Returns whether the last termination came from the heap limit policy, and forgets it
+    bool ClearHeapLimitExceeded(void) {
+        bool exceeded = m_heap_limit_exceeded;
+        m_heap_limit_exceeded = false;
+        return exceeded;
+    }
+
+    // Raises while the heap limit hook runs, it is called by the GC where Javascript can't be used
+    static void CheckHeapLimitHook(v8::Isolate *isolate);
+
+    CScriptCache& GetScriptCache(void) {
+        return *m_script_cache;
+    }
+
+    CNameCache& GetNameCache(void) {
+        return *m_name_cache;
+    }
+
+    CFunctionCache& GetFunctionCache(void) {
+        return *m_function_cache;
+    }
+
+    // The object template of the wrappers of a Python type, templates can't be shared between isolates
+    v8::Local<v8::ObjectTemplate> GetWrapperTemplate(PyTypeObject *type);
+
+    void StartProfiling(const std::string& title, int sampling_interval);
+    // Returns NULL if no profiling was started with the title
+    CCpuProfilePtr StopProfiling(const std::string& title);
+
+    std::unordered_set<ContextTracer *>& GetContextTracers(void) {
+        return m_context_tracers;
+    }
+
+    static CIsolateData *Get(v8::Isolate *isolate);
+    // Returns the data of the isolate, or NULL if it was never created or already disposed
+    static CIsolateData *Find(v8::Isolate *isolate);
+    static void Dispose(v8::Isolate *isolate);
+};
+
 class CIsolate
 {
     v8::Isolate *m_isolate;
     bool m_owner;
-    void Init(bool owner);
-
-    static constexpr int KB = 1024;
-    static constexpr int MB = KB * 1024;
-    static constexpr size_t heap_increase = 8 * MB;
-    static constexpr size_t heap_max_increase = 64 * MB;
+    std::shared_ptr<CSnapshot> m_snapshot;
+    void Init(bool owner, std::shared_ptr<CSnapshot> snapshot, const v8::ResourceConstraints *constraints = NULL);
 public:
     CIsolate();
     CIsolate(bool owner);
+    // The sizes are in bytes, zero keeps the default of V8
+    CIsolate(bool owner, size_t max_old_space, size_t max_young_space, size_t code_range, size_t initial_heap);
     CIsolate(v8::Isolate *isolate);
+    // Creates the isolate from a snapshot read beforehand, with the GIL held, since JSEngine.deserialize may replace it
+    CIsolate(bool owner, std::shared_ptr<CSnapshot> snapshot);
     ~CIsolate(void);
 
     v8::Isolate *GetIsolate(void);
@@ -38,10 +163,38 @@ public:
     }
 
     void Dispose(void) {
+        CIsolateData::Dispose(m_isolate);
+
         m_isolate->Dispose();
+
+        m_snapshot.reset();
     }
 
     bool IsLocked(void) {
         return v8::Locker::IsLocked(m_isolate);
     }
+
+    py::dict GetScriptCacheStats(void);
+    void SetScriptCacheSize(size_t max_entries);
+    void ClearScriptCache(void);
+
+    py::dict GetFunctionCacheStats(void);
+
+    void SetHeapLimitPolicy(CIsolateData::HeapLimitPolicy policy, size_t increase, size_t max_increase, py::object hook);
+    CIsolateData::HeapLimitPolicy GetHeapLimitPolicy(void);
+
+    py::dict GetHeapStatistics(void);
+    py::dict GetHeapSpaceStatistics(void);
+    py::dict GetCodeStatistics(void);
+
+    // Runs a pending task of the isolate, like the completion of a memory measurement
+    bool PumpMessageLoop(bool wait);
+
+    // Streams a heap snapshot to a file in the JSON format of the Chrome DevTools
+    void WriteHeapSnapshot(const std::string& path);
+
+    static constexpr int DEFAULT_SAMPLING_INTERVAL = 1000;
+
+    void StartProfiling(const std::string& name, int sampling_interval_us);
+    CCpuProfilePtr StopProfiling(const std::string& name);
 };
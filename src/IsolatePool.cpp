@@ -0,0 +1,236 @@
+#include "IsolatePool.h"
+#include "Engine.h"
+
+#include <chrono>
+#include <algorithm>
+
+CIsolatePool::CIsolatePool(size_t size, size_t max_uses, size_t max_heap_size)
+    : m_size(size), m_max_uses(max_uses), m_max_heap_size(max_heap_size),
+      m_checkouts(0), m_timeouts(0), m_recycled(0), m_wait_time(0), m_max_wait_time(0)
+{
+    if (size == 0) throw CJavascriptException("the pool needs at least one isolate", ::PyExc_ValueError);
+
+    m_idle.reserve(size);
+
+    for (size_t i=0; i<size; i++)
+    {
+        CEntry entry = { CIsolatePtr(new CIsolate(true)), 0 };
+
+        m_idle.push_back(entry);
+    }
+}
+
+CIsolatePool::~CIsolatePool(void)
+{
+    m_idle.clear();
+}
+
+CPooledIsolatePtr CIsolatePool::Checkout(double timeout)
+{
+    CEntry entry;
+    bool acquired = false;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    if (timeout < 0)
+    {
+        m_available.wait(lock, [this] { return !m_idle.empty(); });
+    }
+    else
+    {
+        m_available.wait_for(lock, std::chrono::duration<double>(timeout), [this] { return !m_idle.empty(); });
+    }
+
+    double waited = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    m_wait_time += waited;
+    m_max_wait_time = std::max(m_max_wait_time, waited);
+
+    if (!m_idle.empty())
+    {
+        entry = m_idle.back();
+        m_idle.pop_back();
+
+        m_checkouts++;
+        acquired = true;
+    }
+    else
+    {
+        m_timeouts++;
+    }
+
+    Py_END_ALLOW_THREADS
+
+    if (!acquired) throw CJavascriptException("no isolate available in the pool", ::PyExc_TimeoutError);
+
+    return CPooledIsolatePtr(new CPooledIsolate(*this, entry.isolate, entry.uses));
+}
+
+void CIsolatePool::Checkin(CIsolatePtr isolate, size_t uses, bool recycle)
+{
+    if (recycle)
+    {
+        CSnapshotPtr snapshot = CEngine::GetSnapshot();
+
+        Py_BEGIN_ALLOW_THREADS
+
+        isolate.reset(new CIsolate(true, snapshot));
+
+        Py_END_ALLOW_THREADS
+
+        uses = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        CEntry entry = { isolate, uses };
+
+        m_idle.push_back(entry);
+
+        if (recycle) m_recycled++;
+    }
+
+    m_available.notify_one();
+}
+
+py::dict CIsolatePool::GetStats(void)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    py::dict stats;
+
+    stats["size"] = m_size;
+    stats["idle"] = m_idle.size();
+    stats["in_use"] = m_size - m_idle.size();
+    stats["checkouts"] = m_checkouts;
+    stats["timeouts"] = m_timeouts;
+    stats["recycled"] = m_recycled;
+    stats["wait_time"] = m_wait_time;
+    stats["max_wait_time"] = m_max_wait_time;
+
+    return stats;
+}
+
+CPooledIsolate::CPooledIsolate(CIsolatePool& pool, CIsolatePtr isolate, size_t uses)
+    : m_pool(pool), m_isolate(isolate), m_uses(uses + 1)
+{
+    m_locker.reset(new v8::Locker(m_isolate->GetIsolate()));
+
+    m_isolate->Enter();
+}
+
+CPooledIsolate::~CPooledIsolate(void)
+{
+    if (!IsCheckedOut()) return;
+
+    if (!v8::Locker::IsLocked(m_isolate->GetIsolate()))
+    {
+        // collected by another thread than the one which checked it out, the locker can't be
+        // released from here, so the isolate is left locked and alive, and lost to the pool
+        if (::PyErr_WarnEx(::PyExc_ResourceWarning, "a pooled isolate was collected without being released "
+                           "by the thread which checked it out", 1) < 0)
+        {
+            ::PyErr_WriteUnraisable(NULL);
+        }
+
+        (void) m_locker.release();
+        new CIsolatePtr(m_isolate);
+    }
+    else if (CIsolateRef::GetCount(m_isolate->GetIsolate()) > 0)
+    {
+        // the Javascript objects of the previous user still hold handles of the isolate, which is
+        // left alive to them and replaced in the pool by a fresh one
+        if (::PyErr_WarnEx(::PyExc_ResourceWarning, "a pooled isolate was collected while Javascript objects "
+                           "of the isolate were still alive", 1) < 0)
+        {
+            ::PyErr_WriteUnraisable(NULL);
+        }
+
+        m_isolate->Leave();
+        m_locker.reset();
+
+        new CIsolatePtr(m_isolate);
+
+        m_pool.Checkin(std::move(m_isolate), m_uses, true);
+    }
+    else
+    {
+        Release();
+    }
+}
+
+CIsolatePtr CPooledIsolate::GetIsolate(void)
+{
+    if (!IsCheckedOut()) throw CJavascriptException("the isolate was released to the pool", ::PyExc_RuntimeError);
+
+    // the pool keeps the ownership of the isolate
+    return CIsolatePtr(new CIsolate(m_isolate->GetIsolate()));
+}
+
+void CPooledIsolate::Release(void)
+{
+    if (!IsCheckedOut()) return;
+
+    v8::Isolate *isolate = m_isolate->GetIsolate();
+
+    // the handles of the wrappers would outlive a recycled isolate, or be used without the lock
+    // by the thread of the next checkout
+    if (CIsolateRef::GetCount(isolate) > 0)
+        throw CJavascriptException("the contexts, objects, scripts and errors of the isolate "
+                                   "must be dropped before it is released", ::PyExc_RuntimeError);
+
+    v8::HeapStatistics heap_stats;
+
+    isolate->GetHeapStatistics(&heap_stats);
+
+    bool recycle = m_pool.NeedRecycle(m_uses, heap_stats.used_heap_size());
+
+    // the wrapper state belongs to the previous user, with its caches, heap limit policy and
+    // running profilings, and it must be released while the isolate is still locked
+    CIsolateData::Dispose(isolate);
+
+    // the contexts of the previous user are garbage now
+    if (!recycle) isolate->ContextDisposedNotification();
+
+    m_isolate->Leave();
+    m_locker.reset();
+
+    m_pool.Checkin(std::move(m_isolate), m_uses, recycle);
+}
+
+void CIsolatePool::Expose(void)
+{
+    py::class_<CIsolatePool, boost::noncopyable>("JSIsolatePool", "JSIsolatePool keeps pre-warmed isolates ready to be used by threads.", py::no_init)
+    .def(py::init<size_t, size_t, size_t>((py::arg("size"),
+                                           py::arg("max_uses") = 0,
+                                           py::arg("max_heap_size") = 0)))
+
+    .add_property("size", &CIsolatePool::GetSize, "the number of isolates of the pool")
+    .add_property("stats", &CIsolatePool::GetStats,
+                  "Get the checkout, timeout, wait time and recycle counters of the pool.")
+
+    .def("checkout", &CIsolatePool::Checkout, (py::arg("timeout") = -1),
+         "Waits for an idle isolate and returns it locked and entered by the current thread.",
+         py::with_custodian_and_ward_postcall<0, 1>())
+    ;
+
+    py::class_<CPooledIsolate, boost::noncopyable>("JSPooledIsolate", "JSPooledIsolate is an isolate checked out of a pool.", py::no_init)
+    .add_property("isolate", &CPooledIsolate::GetIsolate, "the checked out isolate")
+    .add_property("uses", &CPooledIsolate::GetUses, "the number of checkouts served by the isolate")
+    .add_property("checkedOut", &CPooledIsolate::IsCheckedOut)
+
+    .def("release", &CPooledIsolate::Release,
+         "Leaves and unlocks the isolate and returns it to the pool, "
+         "which recycles it when it is over the use count or heap limits. "
+         "Raises RuntimeError while Javascript objects of the isolate are alive.")
+    ;
+
+    py::objects::class_value_wrapper<std::shared_ptr<CPooledIsolate>,
+    py::objects::make_ptr_instance<CPooledIsolate,
+    py::objects::pointer_holder<std::shared_ptr<CPooledIsolate>, CPooledIsolate> > >();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#include "Isolate.h"
+#include "Context.h"
+#include "Utils.h"
+
+class CPooledIsolate;
+
+typedef std::shared_ptr<CPooledIsolate> CPooledIsolatePtr;
+
+// Pool of pre-warmed isolates handed out to threads.
+//
+// The isolates are created ahead of time (from the startup snapshot when one is enabled),
+// checked out with the V8 locker already taken, and checked in again when the thread is done.
+// An isolate which served max_uses checkouts, or whose heap grew over max_heap_size bytes,
+// is disposed on checkin and replaced by a fresh one.
+
+class CIsolatePool
+{
+    struct CEntry
+    {
+        CIsolatePtr isolate;
+        size_t uses;
+    };
+
+    std::mutex m_lock;
+    std::condition_variable m_available;
+
+    std::vector<CEntry> m_idle;
+
+    size_t m_size;
+    size_t m_max_uses;
+    size_t m_max_heap_size;
+
+    size_t m_checkouts;
+    size_t m_timeouts;
+    size_t m_recycled;
+    double m_wait_time;
+    double m_max_wait_time;
+
+    friend class CPooledIsolate;
+
+    bool NeedRecycle(size_t uses, size_t heap_size) const {
+        return (m_max_uses && uses >= m_max_uses) || (m_max_heap_size && heap_size >= m_max_heap_size);
+    }
+
+    void Checkin(CIsolatePtr isolate, size_t uses, bool recycle);
+public:
+    CIsolatePool(size_t size, size_t max_uses = 0, size_t max_heap_size = 0);
+    ~CIsolatePool(void);
+
+    // Waits up to timeout seconds for an idle isolate, forever if timeout is negative
+    CPooledIsolatePtr Checkout(double timeout = -1);
+
+    size_t GetSize(void) const {
+        return m_size;
+    }
+
+    py::dict GetStats(void);
+
+    static void Expose(void);
+};
+
+// An isolate checked out of a pool, locked and entered by the current thread until it is released
+class CPooledIsolate
+{
+    CIsolatePool& m_pool;
+    CIsolatePtr m_isolate;
+    size_t m_uses;
+
+    std::unique_ptr<v8::Locker> m_locker;
+public:
+    CPooledIsolate(CIsolatePool& pool, CIsolatePtr isolate, size_t uses);
+    ~CPooledIsolate(void);
+
+    bool IsCheckedOut(void) const {
+        return m_locker.get() != NULL;
+    }
+
+    size_t GetUses(void) const {
+        return m_uses;
+    }
+
+    CIsolatePtr GetIsolate(void);
+
+    void Release(void);
+};
@@ -0,0 +1,33 @@
+#include "NameCache.h"
+
+CNameCache::~CNameCache(void)
+{
+    CPythonGIL python_gil;
+
+    for (size_t i=0; i<SIZE; i++)
+    {
+        m_entries[i].name.Reset();
+        m_entries[i].key = py::object();
+    }
+}
+
+py::object CNameCache::Get(v8::Local<v8::Name> name)
+{
+    if (!name->IsString()) return py::object();
+
+    CEntry& entry = m_entries[name->GetIdentityHash() & (SIZE - 1)];
+
+    if (entry.name == name) return entry.key;
+
+    py::object str = ToPython(m_isolate, name.As<v8::String>());
+    PyObject *key = str.ptr();
+
+    Py_INCREF(key);
+
+    ::PyUnicode_InternInPlace(&key);
+
+    entry.name.Reset(m_isolate, name);
+    entry.key = py::object(py::handle<>(key));
+
+    return entry.key;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Utils.h"
+
+// Direct-mapped cache from the property names seen by the interceptors of an isolate to
+// interned Python strings.
+//
+// The slots are indexed by the identity hash of the name and hold the name itself, so a
+// hit only compares two handles; the property names are internalized by V8, so the same
+// name always maps to the same slot and the UTF-8 conversion is skipped.
+
+class CNameCache
+{
+    static const size_t SIZE = 256;
+
+    struct CEntry
+    {
+        v8::Global<v8::Name> name;
+        py::object key;
+    };
+
+    v8::Isolate *m_isolate;
+
+    CEntry m_entries[SIZE];
+public:
+    CNameCache(v8::Isolate *isolate) : m_isolate(isolate) {}
+    ~CNameCache(void);
+
+    // Returns the interned Python str of a property name, or None for a symbol
+    py::object Get(v8::Local<v8::Name> name);
+};
@@ -0,0 +1,433 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <tuple>
+#include <unordered_map>
+
+CCpuProfile::CCpuProfile(const std::string& title, const v8::CpuProfile *profile, int sampling_interval, int64_t wall_time)
+    : m_title(title), m_start_time(profile->GetStartTime()), m_end_time(profile->GetEndTime()),
+      m_wall_time(wall_time), m_sampling_interval(sampling_interval)
+{
+    // walk the call tree depth first, without recursing as deep as the Javascript stacks
+    std::unordered_map<const v8::CpuProfileNode *, size_t> indexes;
+    std::vector<std::pair<const v8::CpuProfileNode *, size_t> > pending;
+
+    pending.push_back(std::make_pair(profile->GetTopDownRoot(), 0));
+
+    while (!pending.empty())
+    {
+        const v8::CpuProfileNode *node = pending.back().first;
+        size_t parent = pending.back().second;
+
+        pending.pop_back();
+
+        size_t index = m_nodes.size();
+
+        indexes[node] = index;
+
+        m_nodes.emplace_back();
+
+        CNode& entry = m_nodes.back();
+
+        entry.id = node->GetNodeId();
+        entry.parent = parent;
+        entry.function_name = node->GetFunctionNameStr();
+        entry.url = node->GetScriptResourceNameStr();
+        entry.script_id = node->GetScriptId();
+        entry.line = std::max(node->GetLineNumber(), 0);
+        entry.column = std::max(node->GetColumnNumber(), 0);
+        entry.hit_count = node->GetHitCount();
+
+        unsigned int lines = node->GetHitLineCount();
+
+        if (lines)
+        {
+            entry.line_ticks.resize(lines);
+
+            if (!node->GetLineTicks(entry.line_ticks.data(), lines)) entry.line_ticks.clear();
+        }
+
+        if (index != parent) m_nodes[parent].children.push_back(entry.id);
+
+        for (int i = node->GetChildrenCount() - 1; i >= 0; i--)
+        {
+            pending.push_back(std::make_pair(node->GetChild(i), index));
+        }
+    }
+
+    int count = profile->GetSamplesCount();
+
+    m_samples.reserve(count);
+    m_timestamps.reserve(count);
+
+    for (int i = 0; i < count; i++)
+    {
+        auto it = indexes.find(profile->GetSample(i));
+
+        if (it == indexes.end()) continue;
+
+        m_samples.push_back(it->second);
+        m_timestamps.push_back(profile->GetSampleTimestamp(i));
+    }
+}
+
+namespace {
+
+void WriteJsonString(std::ostream& out, const std::string& str)
+{
+    static const char HEX[] = "0123456789abcdef";
+
+    out << '"';
+
+    for (unsigned char c : str)
+    {
+        switch (c)
+        {
+        case '"':
+            out << "\\\"";
+            break;
+        case '\\':
+            out << "\\\\";
+            break;
+        case '\n':
+            out << "\\n";
+            break;
+        case '\r':
+            out << "\\r";
+            break;
+        case '\t':
+            out << "\\t";
+            break;
+        default:
+            if (c < 0x20)
+            {
+                out << "\\u00" << HEX[c >> 4] << HEX[c & 0xf];
+            }
+            else
+            {
+                out << c;
+            }
+        }
+    }
+
+    out << '"';
+}
+
+// Writer of the protobuf wire format, enough of it for the messages of pprof
+class CProtobufWriter
+{
+    enum WireType
+    {
+        WIRE_VARINT = 0,
+        WIRE_BYTES = 2
+    };
+
+    std::string m_data;
+
+    void Varint(uint64_t value) {
+        while (value >= 0x80)
+        {
+            m_data.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+
+        m_data.push_back(static_cast<char>(value));
+    }
+
+    void Key(int field, WireType type) {
+        Varint((static_cast<uint64_t>(field) << 3) | type);
+    }
+public:
+    const std::string& Data(void) const {
+        return m_data;
+    }
+
+    // the scalar fields holding their default value are left out, like the encoders of proto3 do
+    void Int(int field, int64_t value) {
+        if (!value) return;
+
+        Key(field, WIRE_VARINT);
+        Varint(static_cast<uint64_t>(value));
+    }
+
+    void Bytes(int field, const std::string& value) {
+        Key(field, WIRE_BYTES);
+        Varint(value.size());
+        m_data.append(value);
+    }
+
+    void Message(int field, const CProtobufWriter& message) {
+        Bytes(field, message.m_data);
+    }
+
+    void Packed(int field, const std::vector<uint64_t>& values) {
+        CProtobufWriter packed;
+
+        for (uint64_t value : values) packed.Varint(value);
+
+        Bytes(field, packed.m_data);
+    }
+};
+
+// The field numbers of perftools.profiles.Profile and its nested messages
+enum PprofField
+{
+    PROFILE_SAMPLE_TYPE = 1,
+    PROFILE_SAMPLE = 2,
+    PROFILE_LOCATION = 4,
+    PROFILE_FUNCTION = 5,
+    PROFILE_STRING_TABLE = 6,
+    PROFILE_TIME_NANOS = 9,
+    PROFILE_DURATION_NANOS = 10,
+    PROFILE_PERIOD_TYPE = 11,
+    PROFILE_PERIOD = 12,
+    PROFILE_COMMENT = 13,
+
+    VALUE_TYPE_TYPE = 1,
+    VALUE_TYPE_UNIT = 2,
+
+    SAMPLE_LOCATION_ID = 1,
+    SAMPLE_VALUE = 2,
+
+    LOCATION_ID = 1,
+    LOCATION_LINE = 4,
+
+    LINE_FUNCTION_ID = 1,
+    LINE_LINE = 2,
+
+    FUNCTION_ID = 1,
+    FUNCTION_NAME = 2,
+    FUNCTION_SYSTEM_NAME = 3,
+    FUNCTION_FILENAME = 4,
+    FUNCTION_START_LINE = 5
+};
+
+class CStringTable
+{
+    std::unordered_map<std::string, int64_t> m_indexes;
+    std::vector<const std::string *> m_strings;
+public:
+    CStringTable() {
+        Intern(std::string()); // the first string of the table must be empty
+    }
+
+    int64_t Intern(const std::string& str) {
+        auto it = m_indexes.emplace(str, m_strings.size()).first;
+
+        if (static_cast<size_t>(it->second) == m_strings.size()) m_strings.push_back(&it->first);
+
+        return it->second;
+    }
+
+    void Write(CProtobufWriter& profile) const {
+        for (const std::string *str : m_strings) profile.Bytes(PROFILE_STRING_TABLE, *str);
+    }
+};
+
+}
+
+std::string CCpuProfile::ToCpuProfile(void) const
+{
+    std::ostringstream out;
+
+    out << "{\"nodes\":[";
+
+    for (size_t i = 0; i < m_nodes.size(); i++)
+    {
+        const CNode& node = m_nodes[i];
+
+        if (i) out << ',';
+
+        // the positions of the call frames are 0-based, the ones of the ticks 1-based
+        out << "{\"id\":" << node.id << ",\"callFrame\":{\"functionName\":";
+        WriteJsonString(out, node.function_name);
+        out << ",\"scriptId\":\"" << node.script_id << "\",\"url\":";
+        WriteJsonString(out, node.url);
+        out << ",\"lineNumber\":" << node.line - 1 << ",\"columnNumber\":" << node.column - 1
+            << "},\"hitCount\":" << node.hit_count;
+
+        if (!node.children.empty())
+        {
+            out << ",\"children\":[";
+
+            for (size_t j = 0; j < node.children.size(); j++) out << (j ? "," : "") << node.children[j];
+
+            out << ']';
+        }
+
+        if (!node.line_ticks.empty())
+        {
+            out << ",\"positionTicks\":[";
+
+            for (size_t j = 0; j < node.line_ticks.size(); j++)
+            {
+                out << (j ? "," : "") << "{\"line\":" << node.line_ticks[j].line
+                    << ",\"ticks\":" << node.line_ticks[j].hit_count << '}';
+            }
+
+            out << ']';
+        }
+
+        out << '}';
+    }
+
+    out << "],\"startTime\":" << m_start_time << ",\"endTime\":" << m_end_time << ",\"samples\":[";
+
+    for (size_t i = 0; i < m_samples.size(); i++) out << (i ? "," : "") << m_nodes[m_samples[i]].id;
+
+    out << "],\"timeDeltas\":[";
+
+    int64_t last = m_start_time;
+
+    for (size_t i = 0; i < m_timestamps.size(); i++)
+    {
+        out << (i ? "," : "") << m_timestamps[i] - last;
+
+        last = m_timestamps[i];
+    }
+
+    out << "]}";
+
+    return out.str();
+}
+
+std::string CCpuProfile::ToPprof(void) const
+{
+    CProtobufWriter profile;
+    CStringTable strings;
+
+    CProtobufWriter samples_type, cpu_type;
+
+    samples_type.Int(VALUE_TYPE_TYPE, strings.Intern("samples"));
+    samples_type.Int(VALUE_TYPE_UNIT, strings.Intern("count"));
+    cpu_type.Int(VALUE_TYPE_TYPE, strings.Intern("cpu"));
+    cpu_type.Int(VALUE_TYPE_UNIT, strings.Intern("nanoseconds"));
+
+    profile.Message(PROFILE_SAMPLE_TYPE, samples_type);
+    profile.Message(PROFILE_SAMPLE_TYPE, cpu_type);
+
+    // a node stands for a unique stack, so the samples are summed by their leaf node,
+    // and each sample is counted for the time elapsed since the previous one
+    std::vector<uint64_t> counts(m_nodes.size()), nanos(m_nodes.size());
+
+    int64_t last = m_start_time;
+
+    for (size_t i = 0; i < m_samples.size(); i++)
+    {
+        counts[m_samples[i]]++;
+        nanos[m_samples[i]] += std::max<int64_t>(m_timestamps[i] - last, 0) * 1000;
+
+        last = m_timestamps[i];
+    }
+
+    for (size_t i = 1; i < m_nodes.size(); i++)
+    {
+        if (!counts[i]) continue;
+
+        std::vector<uint64_t> locations;
+
+        for (size_t node = i; node != 0; node = m_nodes[node].parent) locations.push_back(node);
+
+        CProtobufWriter sample;
+
+        sample.Packed(SAMPLE_LOCATION_ID, locations);
+        sample.Packed(SAMPLE_VALUE, { counts[i], nanos[i] });
+
+        profile.Message(PROFILE_SAMPLE, sample);
+    }
+
+    // the location of a node is its index, the root has none, and the functions are shared
+    // by the nodes of the same function called from different stacks
+    std::map<std::tuple<std::string, std::string, int, int>, uint64_t> functions;
+
+    for (size_t i = 1; i < m_nodes.size(); i++)
+    {
+        const CNode& node = m_nodes[i];
+
+        auto key = std::make_tuple(node.function_name, node.url, node.script_id, node.line);
+        auto it = functions.find(key);
+
+        if (it == functions.end())
+        {
+            it = functions.insert(std::make_pair(key, functions.size() + 1)).first;
+
+            int64_t name = strings.Intern(node.function_name.empty() ? "(anonymous)" : node.function_name);
+
+            CProtobufWriter function;
+
+            function.Int(FUNCTION_ID, it->second);
+            function.Int(FUNCTION_NAME, name);
+            function.Int(FUNCTION_SYSTEM_NAME, name);
+            function.Int(FUNCTION_FILENAME, strings.Intern(node.url));
+            function.Int(FUNCTION_START_LINE, node.line);
+
+            profile.Message(PROFILE_FUNCTION, function);
+        }
+
+        CProtobufWriter line, location;
+
+        line.Int(LINE_FUNCTION_ID, it->second);
+        line.Int(LINE_LINE, node.line);
+
+        location.Int(LOCATION_ID, i);
+        location.Message(LOCATION_LINE, line);
+
+        profile.Message(PROFILE_LOCATION, location);
+    }
+
+    profile.Int(PROFILE_TIME_NANOS, m_wall_time);
+    profile.Int(PROFILE_DURATION_NANOS, (m_end_time - m_start_time) * 1000);
+    profile.Message(PROFILE_PERIOD_TYPE, cpu_type);
+    profile.Int(PROFILE_PERIOD, static_cast<int64_t>(m_sampling_interval) * 1000);
+
+    if (!m_title.empty()) profile.Int(PROFILE_COMMENT, strings.Intern(m_title));
+
+    strings.Write(profile);
+
+    return profile.Data();
+}
+
+py::object CCpuProfile::GetPprof(void) const
+{
+    std::string data = ToPprof();
+
+    return py::object(py::handle<>(::PyBytes_FromStringAndSize(data.c_str(), data.size())));
+}
+
+void CCpuProfile::WriteFile(const std::string& path, const std::string& data)
+{
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!file) throw CJavascriptException("fail to open the profile file " + path, ::PyExc_OSError);
+
+    file.write(data.c_str(), data.size());
+    file.close();
+
+    if (!file) throw CJavascriptException("fail to write the profile file " + path, ::PyExc_OSError);
+}
+
+void CCpuProfile::Expose(void)
+{
+    py::class_<CCpuProfile, boost::noncopyable>("JSCpuProfile", "JSCpuProfile is a CPU profile collected by JSIsolate.", py::no_init)
+    .add_property("title", &CCpuProfile::GetTitle, "the title the profiling was started with")
+    .add_property("startTime", &CCpuProfile::GetStartTime, "the start time in microseconds")
+    .add_property("endTime", &CCpuProfile::GetEndTime, "the end time in microseconds")
+    .add_property("samplesCount", &CCpuProfile::GetSamplesCount, "the number of collected samples")
+
+    .def("to_cpuprofile", &CCpuProfile::ToCpuProfile,
+         "Serializes the profile to the .cpuprofile JSON format loaded by the Chrome DevTools.")
+    .def("to_pprof", &CCpuProfile::GetPprof,
+         "Serializes the profile to the uncompressed pprof protobuf format.")
+    .def("write_cpuprofile", &CCpuProfile::WriteCpuProfile, (py::arg("path")),
+         "Writes the profile to a .cpuprofile file for the Chrome DevTools.")
+    .def("write_pprof", &CCpuProfile::WritePprof, (py::arg("path")),
+         "Writes the profile to a pprof file for `go tool pprof`.")
+    ;
+
+    py::objects::class_value_wrapper<std::shared_ptr<CCpuProfile>,
+    py::objects::make_ptr_instance<CCpuProfile,
+    py::objects::pointer_holder<std::shared_ptr<CCpuProfile>, CCpuProfile> > >();
+}
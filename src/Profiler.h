@@ -0,0 +1,83 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <v8.h>
+#include <v8-profiler.h>
+
+#include "Exception.h"
+
+class CCpuProfile;
+
+typedef std::shared_ptr<CCpuProfile> CCpuProfilePtr;
+
+// CPU profile collected by the sampling profiler of an isolate.
+//
+// The call tree and the samples are copied out of V8 when the profiling stops, so the profile
+// doesn't depend on its isolate anymore, and can be written as a .cpuprofile for the Chrome
+// DevTools or as a pprof protobuf, where the frames of the JIT code are already symbolized.
+
+class CCpuProfile
+{
+    struct CNode
+    {
+        unsigned id;
+        size_t parent; // the index of the parent node, the root is its own parent
+
+        std::string function_name;
+        std::string url;
+        int script_id;
+        int line;   // 1-based, 0 when unknown
+        int column; // 1-based, 0 when unknown
+        unsigned hit_count;
+
+        std::vector<unsigned> children;
+        std::vector<v8::CpuProfileNode::LineTick> line_ticks;
+    };
+
+    std::string m_title;
+    int64_t m_start_time; // microseconds, on the monotonic clock of V8
+    int64_t m_end_time;
+    int64_t m_wall_time;  // nanoseconds since the epoch when the profiling started
+    int m_sampling_interval;
+
+    std::vector<CNode> m_nodes;
+    std::vector<size_t> m_samples; // the index of the leaf node of each sample
+    std::vector<int64_t> m_timestamps;
+
+    static void WriteFile(const std::string& path, const std::string& data);
+public:
+    CCpuProfile(const std::string& title, const v8::CpuProfile *profile, int sampling_interval, int64_t wall_time);
+
+    std::string GetTitle(void) const {
+        return m_title;
+    }
+    int64_t GetStartTime(void) const {
+        return m_start_time;
+    }
+    int64_t GetEndTime(void) const {
+        return m_end_time;
+    }
+    size_t GetSamplesCount(void) const {
+        return m_samples.size();
+    }
+
+    // Serializes the profile in the JSON format of the Chrome DevTools
+    std::string ToCpuProfile(void) const;
+
+    // Serializes the profile as an uncompressed perftools.profiles.Profile message
+    std::string ToPprof(void) const;
+
+    py::object GetPprof(void) const;
+
+    void WriteCpuProfile(const std::string& path) const {
+        WriteFile(path, ToCpuProfile());
+    }
+    void WritePprof(const std::string& path) const {
+        WriteFile(path, ToPprof());
+    }
+
+    static void Expose(void);
+};
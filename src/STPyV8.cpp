@@ -4,6 +4,8 @@
 #include "Context.h"
 #include "Engine.h"
 #include "Locker.h"
+#include "IsolatePool.h"
+#include "Profiler.h"
 
 
 BOOST_PYTHON_MODULE(_STPyV8)
@@ -13,6 +15,8 @@ BOOST_PYTHON_MODULE(_STPyV8)
     CContext::Expose();
     CEngine::Expose();
     CLocker::Expose();
+    CIsolatePool::Expose();
+    CCpuProfile::Expose();
 }
 
 
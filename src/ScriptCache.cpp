@@ -0,0 +1,108 @@
+#include "ScriptCache.h"
+
+CScriptCache::CKey CScriptCache::MakeKey(v8::Handle<v8::Value> name, int line, int col, uint64_t source_hash)
+{
+    // the identity hash of a V8 string is computed from its content
+    int name_hash = (!name.IsEmpty() && name->IsName()) ? v8::Handle<v8::Name>::Cast(name)->GetIdentityHash() : 0;
+
+    return CKey(source_hash, name_hash, line, col);
+}
+
+v8::MaybeLocal<v8::UnboundScript> CScriptCache::Lookup(v8::Handle<v8::String> source, v8::Handle<v8::Value> name,
+                                                       int line, int col, uint64_t source_hash)
+{
+    v8::EscapableHandleScope handle_scope(m_isolate);
+
+    CEntryMap::iterator it = m_index.find(MakeKey(name, line, col, source_hash));
+
+    if (it != m_index.end())
+    {
+        CEntry& entry = *it->second;
+
+        // guard against hash collisions before trusting the entry
+        if (source->StringEquals(entry.source.Get(m_isolate)) &&
+            name->StrictEquals(entry.name.Get(m_isolate)))
+        {
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            m_hits++;
+
+            return handle_scope.Escape(entry.script.Get(m_isolate));
+        }
+    }
+
+    m_misses++;
+
+    return v8::MaybeLocal<v8::UnboundScript>();
+}
+
+void CScriptCache::Insert(v8::Handle<v8::String> source, v8::Handle<v8::Value> name,
+                          int line, int col, uint64_t source_hash, v8::Handle<v8::UnboundScript> script)
+{
+    if (m_max_entries == 0) return;
+
+    CKey key = MakeKey(name, line, col, source_hash);
+    CEntryMap::iterator it = m_index.find(key);
+
+    if (it != m_index.end())
+    {
+        m_size -= it->second->size;
+        m_entries.erase(it->second);
+        m_index.erase(it);
+    }
+
+    Evict(m_max_entries - 1);
+
+    m_entries.emplace_front();
+
+    CEntry& entry = m_entries.front();
+
+    entry.key = key;
+    entry.size = source->Length() * (source->IsOneByte() ? 1 : 2);
+    entry.source.Reset(m_isolate, source);
+    entry.name.Reset(m_isolate, name);
+    entry.script.Reset(m_isolate, script);
+
+    m_index[key] = m_entries.begin();
+    m_size += entry.size;
+}
+
+void CScriptCache::Evict(size_t max_entries)
+{
+    while (m_entries.size() > max_entries)
+    {
+        m_size -= m_entries.back().size;
+        m_index.erase(m_entries.back().key);
+        m_entries.pop_back();
+
+        m_evictions++;
+    }
+}
+
+void CScriptCache::Clear(void)
+{
+    m_index.clear();
+    m_entries.clear();
+    m_size = 0;
+}
+
+void CScriptCache::SetMaxEntries(size_t max_entries)
+{
+    m_max_entries = max_entries;
+
+    Evict(m_max_entries);
+}
+
+py::dict CScriptCache::GetStats(void) const
+{
+    py::dict stats;
+
+    stats["entries"] = m_entries.size();
+    stats["max_entries"] = m_max_entries;
+    stats["source_bytes"] = m_size;
+    stats["hits"] = m_hits;
+    stats["misses"] = m_misses;
+    stats["evictions"] = m_evictions;
+    stats["hit_rate"] = (m_hits + m_misses) ? (double) m_hits / (m_hits + m_misses) : 0.0;
+
+    return stats;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <tuple>
+
+#include "Utils.h"
+
+// In-memory cache of compiled scripts of an isolate.
+//
+// The scripts are kept as context-independent v8::UnboundScript, keyed by the source
+// hash, the script name and the line/column offsets, so evaluating the same snippet
+// again only binds the cached script to the current context and skips the parser.
+
+class CScriptCache
+{
+    typedef std::tuple<uint64_t, int, int, int> CKey;
+
+    struct CEntry
+    {
+        CKey key;
+        size_t size; // of the source only, V8 doesn't report the size of the compiled code
+
+        v8::Global<v8::String> source;
+        v8::Global<v8::Value> name;
+        v8::Global<v8::UnboundScript> script;
+    };
+
+    typedef std::list<CEntry> CEntryList;
+    typedef std::map<CKey, CEntryList::iterator> CEntryMap;
+
+    v8::Isolate *m_isolate;
+
+    size_t m_max_entries;
+    size_t m_size;
+
+    CEntryList m_entries; // most recently used first
+    CEntryMap m_index;
+
+    size_t m_hits;
+    size_t m_misses;
+    size_t m_evictions;
+
+    static CKey MakeKey(v8::Handle<v8::Value> name, int line, int col, uint64_t source_hash);
+
+    void Evict(size_t max_entries);
+public:
+    static const size_t DEFAULT_MAX_ENTRIES = 256;
+
+    CScriptCache(v8::Isolate *isolate)
+        : m_isolate(isolate), m_max_entries(DEFAULT_MAX_ENTRIES), m_size(0),
+          m_hits(0), m_misses(0), m_evictions(0)
+    {
+    }
+
+    v8::MaybeLocal<v8::UnboundScript> Lookup(v8::Handle<v8::String> source, v8::Handle<v8::Value> name,
+                                             int line, int col, uint64_t source_hash);
+    void Insert(v8::Handle<v8::String> source, v8::Handle<v8::Value> name,
+                int line, int col, uint64_t source_hash, v8::Handle<v8::UnboundScript> script);
+
+    void Clear(void);
+
+    size_t GetMaxEntries(void) const {
+        return m_max_entries;
+    }
+    void SetMaxEntries(size_t max_entries);
+
+    py::dict GetStats(void) const;
+};
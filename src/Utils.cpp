@@ -10,6 +10,36 @@
 #include "utf8.h"
 //#include "Locker.h" //TODO port me
 
+// Transcodes UCS-4 code points to UTF-16, encoding the astral code points as surrogate pairs
+template <typename T>
+static v8::Local<v8::String> NewFromUcs4(v8::Isolate *isolate, const T *str, size_t len)
+{
+    std::vector<uint16_t> data;
+
+    data.reserve(len + 1);
+
+    for (size_t i=0; i<len; i++)
+    {
+        uint32_t c = (uint32_t) str[i];
+
+        if (c > 0xFFFF)
+        {
+            c -= 0x10000;
+
+            data.push_back((uint16_t) (0xD800 + (c >> 10)));
+            data.push_back((uint16_t) (0xDC00 + (c & 0x3FF)));
+        }
+        else
+        {
+            data.push_back((uint16_t) c);
+        }
+    }
+
+    data.push_back(0);
+
+    return v8::String::NewFromTwoByte(isolate, &data[0], v8::NewStringType::kNormal, data.size() - 1).ToLocalChecked();
+}
+
 v8::Handle<v8::String> ToString(const std::string& str)
 {
     v8::EscapableHandleScope scope(v8::Isolate::GetCurrent());
@@ -38,22 +68,7 @@ v8::Handle<v8::String> ToString(const std::wstring& str)
                    .ToLocalChecked());
     }
 
-    std::vector<uint16_t> data(str.size()+1);
-
-    for (size_t i=0; i<str.size(); i++)
-    {
-        data[i] = (uint16_t) str[i];
-    }
-
-    data[str.size()] = 0;
-
-    return scope.Escape(
-               v8::String::NewFromTwoByte(
-                   v8::Isolate::GetCurrent(),
-                   &data[0],
-                   v8::NewStringType::kNormal,
-                   str.size())
-               .ToLocalChecked());
+    return scope.Escape(NewFromUcs4(v8::Isolate::GetCurrent(), str.c_str(), str.size()));
 }
 
 v8::Handle<v8::String> ToString(py::object str)
@@ -73,30 +88,86 @@ v8::Handle<v8::String> ToString(py::object str)
 
     if (PyUnicode_CheckExact(str.ptr()))
     {
-        int kind = PyUnicode_KIND(str.ptr());
         void *dp = PyUnicode_DATA(str.ptr());
-
         Py_ssize_t len = PyUnicode_GET_LENGTH(str.ptr());
-        std::vector<uint16_t> data(len + 1);
 
-        for (Py_ssize_t i = 0; i < len; i++) {
-            data[i] = (uint16_t) PyUnicode_READ(kind, dp, i);
-        }
+        // the Latin-1 and UCS-2 representations of Python are the V8 one-byte and two-byte strings
+        switch (PyUnicode_KIND(str.ptr()))
+        {
+        case PyUnicode_1BYTE_KIND:
+            return scope.Escape(
+                       v8::String::NewFromOneByte(
+                           v8::Isolate::GetCurrent(),
+                           static_cast<const uint8_t *>(dp),
+                           v8::NewStringType::kNormal,
+                           len)
+                       .ToLocalChecked());
 
-        data[len] = 0;
+        case PyUnicode_2BYTE_KIND:
+            return scope.Escape(
+                       v8::String::NewFromTwoByte(
+                           v8::Isolate::GetCurrent(),
+                           static_cast<const uint16_t *>(dp),
+                           v8::NewStringType::kNormal,
+                           len)
+                       .ToLocalChecked());
 
-        return scope.Escape(
-                   v8::String::NewFromTwoByte(
-                       v8::Isolate::GetCurrent(),
-                       &data[0],
-                       v8::NewStringType::kNormal,
-                       len)
-                   .ToLocalChecked());
+        default:
+            return scope.Escape(NewFromUcs4(v8::Isolate::GetCurrent(), static_cast<const Py_UCS4 *>(dp), len));
+        }
     }
 
     return ToString(py::object(py::handle<>(::PyObject_Str(str.ptr()))));
 }
 
+py::object ToPython(v8::Isolate *isolate, v8::Handle<v8::String> str)
+{
+    int len = str->Length();
+
+    if (str->IsOneByte())
+    {
+        // a pure ASCII string must be created as such, its storage layout differs from Latin-1
+        Py_UCS4 maxchar = str->Utf8Length(isolate) == len ? 0x7F : 0xFF;
+
+        PyObject *obj = ::PyUnicode_New(len, maxchar);
+
+        if (!obj) throw py::error_already_set();
+
+        str->WriteOneByte(isolate, PyUnicode_1BYTE_DATA(obj), 0, len, v8::String::NO_NULL_TERMINATION);
+
+        return py::object(py::handle<>(obj));
+    }
+
+    // the content of a two-byte string may still fit in a narrower Python representation,
+    // and the surrogate pairs must be combined, which the UTF-16 decoder does in one pass;
+    // lone surrogates become U+FFFD, as they did through UTF-8
+    uint16_t buf[256];
+    std::vector<uint16_t> heap_buf;
+
+    uint16_t *data = buf;
+
+    if (len > (int) (sizeof(buf) / sizeof(buf[0])))
+    {
+        heap_buf.resize(len);
+        data = &heap_buf[0];
+    }
+
+    str->Write(isolate, data, 0, len, v8::String::NO_NULL_TERMINATION);
+
+#if PY_LITTLE_ENDIAN
+    int byteorder = -1;
+#else
+    int byteorder = 1;
+#endif
+
+    PyObject *obj = ::PyUnicode_DecodeUTF16(reinterpret_cast<const char *>(data), len * sizeof(uint16_t),
+                                            "replace", &byteorder);
+
+    if (!obj) throw py::error_already_set();
+
+    return py::object(py::handle<>(obj));
+}
+
 v8::Handle<v8::String> DecodeUtf8(const std::string& str)
 {
     v8::EscapableHandleScope scope(v8::Isolate::GetCurrent());
@@ -131,6 +202,22 @@ const std::string EncodeUtf8(const std::wstring& str)
     return std::string((const char *) &data[0], data.size());
 }
 
+uint64_t HashBytes(const void *data, size_t size)
+{
+    // 64-bit FNV-1a, stable across processes so it may be used for on-disk keys
+
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i=0; i<size; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
 
 CPythonGIL::CPythonGIL()
 {
@@ -141,3 +228,35 @@ CPythonGIL::~CPythonGIL()
 {
     ::PyGILState_Release(m_state);
 }
+
+std::mutex CIsolateRef::s_lock;
+std::unordered_map<v8::Isolate *, size_t> CIsolateRef::s_refs;
+
+void CIsolateRef::AddRef(v8::Isolate *isolate)
+{
+    if (!isolate) return;
+
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    s_refs[isolate]++;
+}
+
+void CIsolateRef::Unref(v8::Isolate *isolate)
+{
+    if (!isolate) return;
+
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    std::unordered_map<v8::Isolate *, size_t>::iterator it = s_refs.find(isolate);
+
+    if (it != s_refs.end() && --it->second == 0) s_refs.erase(it);
+}
+
+size_t CIsolateRef::GetCount(v8::Isolate *isolate)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    std::unordered_map<v8::Isolate *, size_t>::const_iterator it = s_refs.find(isolate);
+
+    return it == s_refs.end() ? 0 : it->second;
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <mutex>
+#include <unordered_map>
 
 #ifdef _WIN32
 #ifdef DEBUG
@@ -94,9 +96,14 @@ v8::Handle<v8::String> ToString(const std::string& str);
 v8::Handle<v8::String> ToString(const std::wstring& str);
 v8::Handle<v8::String> ToString(py::object str);
 
+// Converts a Javascript string to a Python str without an intermediate UTF-8 encoding
+py::object ToPython(v8::Isolate *isolate, v8::Handle<v8::String> str);
+
 v8::Handle<v8::String> DecodeUtf8(const std::string& str);
 const std::string EncodeUtf8(const std::wstring& str);
 
+uint64_t HashBytes(const void *data, size_t size);
+
 struct CPythonGIL
 {
     PyGILState_STATE m_state;
@@ -104,3 +111,35 @@ struct CPythonGIL
     CPythonGIL();
     ~CPythonGIL();
 };
+
+// Counts the wrappers holding handles of an isolate, which can't be disposed or handed to
+// another thread while any of them is alive
+class CIsolateRef
+{
+    v8::Isolate *m_isolate;
+
+    static std::mutex s_lock;
+    static std::unordered_map<v8::Isolate *, size_t> s_refs;
+
+    static void AddRef(v8::Isolate *isolate);
+    static void Unref(v8::Isolate *isolate);
+public:
+    CIsolateRef(v8::Isolate *isolate = v8::Isolate::GetCurrent()) : m_isolate(isolate) {
+        AddRef(m_isolate);
+    }
+    CIsolateRef(const CIsolateRef& ref) : m_isolate(ref.m_isolate) {
+        AddRef(m_isolate);
+    }
+    ~CIsolateRef(void) {
+        Unref(m_isolate);
+    }
+
+    CIsolateRef& operator=(const CIsolateRef& ref) {
+        AddRef(ref.m_isolate);
+        Unref(m_isolate);
+        m_isolate = ref.m_isolate;
+        return *this;
+    }
+
+    static size_t GetCount(v8::Isolate *isolate);
+};
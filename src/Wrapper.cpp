@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <unordered_map>
 
 #include <boost/python/raw_function.hpp>
 #include <descrobject.h>
@@ -11,6 +13,8 @@
 #include "libplatform/libplatform.h"
 
 #include "Context.h"
+#include "NameCache.h"
+#include "FunctionCache.h"
 #include "Utils.h"
 
 
@@ -24,7 +28,8 @@
 #define CHECK_V8_CONTEXT() \
   if (v8::Isolate::GetCurrent()->GetCurrentContext().IsEmpty()) { \
     throw CJavascriptException("Javascript object out of context", PyExc_UnboundLocalError); \
-  }
+  } \
+  CIsolateData::CheckHeapLimitHook(v8::Isolate::GetCurrent());
 
 std::ostream& operator <<(std::ostream& os, const CJavascriptObject& obj)
 {
@@ -50,6 +55,10 @@ void CWrapper::Expose(void)
     // Emulating dict object
     .def("keys", &CJavascriptObject::GetAttrList, "Get a list of the object attributes.")
 
+    .def("to_python", &CJavascriptObject::ConvertToPython, (py::arg("depth") = py::object()),
+         "Converts the object and the objects it refers to into plain dicts, lists and scalars, "
+         "down to depth levels of objects, keeping the shared references and the cycles.")
+
     .def("__getitem__", &CJavascriptObject::GetAttr)
     .def("__setitem__", &CJavascriptObject::SetAttr)
     .def("__delitem__", &CJavascriptObject::DelAttr)
@@ -91,12 +100,20 @@ void CWrapper::Expose(void)
     .def("__setitem__", &CJavascriptArray::SetItem)
     .def("__delitem__", &CJavascriptArray::DelItem)
 
-    .def("__iter__", py::range(&CJavascriptArray::begin, &CJavascriptArray::end))
+    .def("__iter__", &CJavascriptArray::Iter)
+
+    .def("tolist", &CJavascriptArray::ToList,
+         "Converts all the elements of the array to a list in a single pass.")
 
     .def("__contains__", &CJavascriptArray::Contains)
     ;
 
-    py::class_<CJavascriptFunction, py::bases<CJavascriptObject>, boost::noncopyable>("JSFunction", py::no_init)
+    py::class_<CJavascriptArrayIterator>("JSArrayIterator", py::no_init)
+    .def("__iter__", py::objects::identity_function())
+    .def("__next__", &CJavascriptArrayIterator::Next)
+    ;
+
+    py::object function_class = py::class_<CJavascriptFunction, py::bases<CJavascriptObject>, boost::noncopyable>("JSFunction", py::no_init)
     .def("__call__", py::raw_function(&CJavascriptFunction::CallWithArgs))
 
     .def("apply", &CJavascriptFunction::ApplyJavascript,
@@ -113,6 +130,15 @@ void CWrapper::Expose(void)
          (py::arg("args") = py::list(),
           py::arg("kwds") = py::dict()),
          "Performs a binding method call using the parameters.")
+    .def("prepare", &CJavascriptFunction::Prepare, (py::arg("receiver") = py::object()),
+         "Pins the function with a receiver (its owner by default) and the current context, "
+         "for a function called at a high rate.")
+    .def("map", &CJavascriptFunction::Map,
+         (py::arg("iterable"),
+          py::arg("chunk_size") = CJavascriptFunction::DEFAULT_CHUNK_SIZE),
+         "Calls the function with each item of the iterable, a tuple of arguments or a single argument, "
+         "and returns the list of results. The exception of a failed call reports "
+         "the index of the item and the results of the previous ones.")
 
     .def("setName", &CJavascriptFunction::SetName)
 
@@ -124,6 +150,13 @@ void CWrapper::Expose(void)
     .add_property("resname", &CJavascriptFunction::GetResourceName, "The resource name of script")
     .add_property("inferredname", &CJavascriptFunction::GetInferredName, "Name inferred from variable or property assignment of this function")
     ;
+
+    // a direct call skips the overload resolution and the argument list of the raw function
+    reinterpret_cast<PyTypeObject *>(function_class.ptr())->tp_call = CJavascriptFunction::CallFunction;
+
+    CJavascriptBuffer::Expose();
+    CJavascriptPreparedCall::Expose();
+
     py::objects::class_value_wrapper<std::shared_ptr<CJavascriptObject>,
     py::objects::make_ptr_instance<CJavascriptObject,
     py::objects::pointer_holder<std::shared_ptr<CJavascriptObject>, CJavascriptObject> > >();
@@ -271,6 +304,9 @@ void CPythonObject::ThrowIf(v8::Isolate* isolate)
 #define CALLBACK_RETURN_NOT_HANDLED(value) do { info.GetReturnValue().Set(value); return v8::Intercepted::kNo; } while(0);
 #define CALLBACK_RETURN_NO_INTERCEPT(value) do { info.GetReturnValue().Set(value); return; } while(0);
 
+// the capabilities of the wrapped Python type are passed as the data of the interceptors
+#define CALLBACK_TYPE_FLAGS() (info.Data().template As<v8::Int32>()->Value())
+
 
 CPythonObject::CPythonObject()
 {
@@ -288,15 +324,18 @@ v8::Intercepted CPythonObject::NamedGetter(v8::Local<v8::Name> prop, const v8::P
 
     CPythonGIL python_gil;
 
-    py::object obj = CJavascriptObject::Wrap(info.Holder());
-    if (PyGen_Check(obj.ptr()))
-        CALLBACK_RETURN_HANDLED(v8::Undefined(info.GetIsolate()));
+    int flags = CALLBACK_TYPE_FLAGS();
 
-    v8::String::Utf8Value name(info.GetIsolate(), v8::Local<v8::String>::Cast(prop));
-    if (*name == nullptr)
+    if (flags & TYPE_GENERATOR)
         CALLBACK_RETURN_HANDLED(v8::Undefined(info.GetIsolate()));
 
-    PyObject *value = ::PyObject_GetAttrString(obj.ptr(), *name);
+    py::object obj = CJavascriptObject::Wrap(info.Holder());
+
+    py::object name = CIsolateData::Get(info.GetIsolate())->GetNameCache().Get(prop);
+    if (name.is_none())
+        CALLBACK_RETURN_NOT_HANDLED(v8::Handle<v8::Value>());
+
+    PyObject *value = ::PyObject_GetAttr(obj.ptr(), name.ptr());
 
     if (!value)
     {
@@ -312,20 +351,20 @@ v8::Intercepted CPythonObject::NamedGetter(v8::Local<v8::Name> prop, const v8::P
             }
         }
 
-        if (::PyMapping_Check(obj.ptr()))
+        if (flags & TYPE_MAPPING)
         {
             int rc;
 
 #if PY_VERSION_HEX >= 0x030d0000
-            rc = ::PyMapping_HasKeyStringWithError(obj.ptr(), *name);
+            rc = ::PyMapping_HasKeyWithError(obj.ptr(), name.ptr());
             if (rc == -1)
                 ::PyErr_Clear();
 #else
-            rc = ::PyMapping_HasKeyString(obj.ptr(), *name);
+            rc = ::PyMapping_HasKey(obj.ptr(), name.ptr());
 #endif
             if (rc == 1)
             {
-                py::object result(py::handle<>(::PyMapping_GetItemString(obj.ptr(), *name)));
+                py::object result(py::handle<>(::PyObject_GetItem(obj.ptr(), name.ptr())));
 
                 if (!result.is_none())
                     CALLBACK_RETURN_HANDLED(Wrap(result));
@@ -362,21 +401,24 @@ v8::Intercepted CPythonObject::NamedSetter(v8::Local<v8::Name> prop, v8::Local<v
 
     CPythonGIL python_gil;
 
+    int flags = CALLBACK_TYPE_FLAGS();
+
     py::object obj = CJavascriptObject::Wrap(info.Holder());
 
-    v8::String::Utf8Value name(info.GetIsolate(), prop);
+    py::object name = CIsolateData::Get(info.GetIsolate())->GetNameCache().Get(prop);
 
-    if (*name == nullptr)
+    if (name.is_none())
         CALLBACK_RETURN_NOT_HANDLED(v8::Undefined(info.GetIsolate()));
 
     py::object newval = CJavascriptObject::Wrap(value);
 
-    bool found = 1 == ::PyObject_HasAttrString(obj.ptr(), *name);
+    bool found = 1 == ::PyObject_HasAttr(obj.ptr(), name.ptr());
 
+    // the watchpoints can be set on the instance, or on its class at any time
     if (::PyObject_HasAttrString(obj.ptr(), "__watchpoints__"))
     {
         py::dict watchpoints(obj.attr("__watchpoints__"));
-        py::str propname(*name, name.length());
+        py::str propname(name);
 
         if (watchpoints.has_key(propname))
         {
@@ -386,16 +428,16 @@ v8::Intercepted CPythonObject::NamedSetter(v8::Local<v8::Name> prop, v8::Local<v
         }
     }
 
-    if (!found && ::PyMapping_Check(obj.ptr()))
+    if (!found && (flags & TYPE_MAPPING))
     {
-        ::PyMapping_SetItemString(obj.ptr(), *name, newval.ptr());
+        ::PyObject_SetItem(obj.ptr(), name.ptr(), newval.ptr());
     }
     else
     {
 #ifdef SUPPORT_PROPERTY
         if (found)
         {
-            py::object attr = obj.attr(*name);
+            py::object attr(py::handle<>(::PyObject_GetAttr(obj.ptr(), name.ptr())));
 
             if (PyObject_TypeCheck(attr.ptr(), &::PyProperty_Type))
             {
@@ -410,7 +452,8 @@ v8::Intercepted CPythonObject::NamedSetter(v8::Local<v8::Name> prop, v8::Local<v
             }
         }
 #endif
-        obj.attr(*name) = newval;
+        if (::PyObject_SetAttr(obj.ptr(), name.ptr(), newval.ptr()) < 0)
+            py::throw_error_already_set();
     }
 
     CALLBACK_RETURN_HANDLED(value);
@@ -426,35 +469,37 @@ v8::Intercepted CPythonObject::NamedQuery(v8::Local<v8::Name> prop, const v8::Pr
 
     CPythonGIL python_gil;
 
+    int flags = CALLBACK_TYPE_FLAGS();
+
     py::object obj = CJavascriptObject::Wrap(info.Holder());
 
-    v8::String::Utf8Value name(info.GetIsolate(), prop);
+    py::object name = CIsolateData::Get(info.GetIsolate())->GetNameCache().Get(prop);
 
-    if (*name)
+    if (!name.is_none())
     {
         int rc;
 
-        if (PyGen_Check(obj.ptr()))
+        if (flags & TYPE_GENERATOR)
             CALLBACK_RETURN_HANDLED(v8::Integer::New(info.GetIsolate(), v8::None));
 
 #if PY_VERSION_HEX >= 0x030d0000
-        rc = ::PyObject_HasAttrStringWithError(obj.ptr(), *name);
+        rc = ::PyObject_HasAttrWithError(obj.ptr(), name.ptr());
         if (rc == -1)
             ::PyErr_Clear();
 #else
-        rc = ::PyObject_HasAttrString(obj.ptr(), *name);
+        rc = ::PyObject_HasAttr(obj.ptr(), name.ptr());
 #endif
         if (rc == 1)
             CALLBACK_RETURN_HANDLED(v8::Integer::New(info.GetIsolate(), v8::None));
 
-        if (::PyMapping_Check(obj.ptr()))
+        if (flags & TYPE_MAPPING)
         {
 #if PY_VERSION_HEX >= 0x030d0000
-            rc = ::PyMapping_HasKeyStringWithError(obj.ptr(), *name);
+            rc = ::PyMapping_HasKeyWithError(obj.ptr(), name.ptr());
             if (rc == -1)
                 ::PyErr_Clear();
 #else
-            rc = ::PyMapping_HasKeyString(obj.ptr(), *name);
+            rc = ::PyMapping_HasKey(obj.ptr(), name.ptr());
 #endif
             if (rc == 1)
                 CALLBACK_RETURN_HANDLED(v8::Integer::New(info.GetIsolate(), v8::None));
@@ -475,31 +520,34 @@ v8::Intercepted CPythonObject::NamedDeleter(v8::Local<v8::Name> prop, const v8::
 
     py::object obj = CJavascriptObject::Wrap(info.Holder());
 
-    v8::String::Utf8Value name(info.GetIsolate(), prop);
+    py::object name = CIsolateData::Get(info.GetIsolate())->GetNameCache().Get(prop);
 
-    if (!::PyObject_HasAttrString(obj.ptr(), *name) &&
-            ::PyMapping_Check(obj.ptr()))
+    if (name.is_none())
+        CALLBACK_RETURN_NOT_HANDLED(v8::Handle<v8::Boolean>());
+
+    if (!::PyObject_HasAttr(obj.ptr(), name.ptr()) &&
+            (CALLBACK_TYPE_FLAGS() & TYPE_MAPPING))
     {
         int rc;
 
 #if PY_VERSION_HEX >= 0x030d0000
-        rc = ::PyMapping_HasKeyStringWithError(obj.ptr(), *name);
+        rc = ::PyMapping_HasKeyWithError(obj.ptr(), name.ptr());
         if (rc == -1)
             ::PyErr_Clear();
 #else
-        rc = ::PyMapping_HasKeyString(obj.ptr(), *name);
+        rc = ::PyMapping_HasKey(obj.ptr(), name.ptr());
 #endif
         if (rc == 1)
         {
-            CALLBACK_RETURN_HANDLED(-1 != ::PyMapping_DelItemString(obj.ptr(), *name));
+            CALLBACK_RETURN_HANDLED(-1 != ::PyObject_DelItem(obj.ptr(), name.ptr()));
         }
     }
     else
     {
 #ifdef SUPPORT_PROPERTY
-        py::object attr = obj.attr(*name);
+        py::object attr(py::handle<>(::PyObject_GetAttr(obj.ptr(), name.ptr())));
 
-        if (::PyObject_HasAttrString(obj.ptr(), *name) &&
+        if (::PyObject_HasAttr(obj.ptr(), name.ptr()) &&
                 PyObject_TypeCheck(attr.ptr(), &::PyProperty_Type))
         {
             py::object deleter = attr.attr("fdel");
@@ -511,10 +559,10 @@ v8::Intercepted CPythonObject::NamedDeleter(v8::Local<v8::Name> prop, const v8::
         }
         else
         {
-            CALLBACK_RETURN_HANDLED(-1 != ::PyObject_DelAttrString(obj.ptr(), *name));
+            CALLBACK_RETURN_HANDLED(-1 != ::PyObject_DelAttr(obj.ptr(), name.ptr()));
         }
 #else
-        CALLBACK_RETURN_HANDLED(-1 != ::PyObject_DelAttrString(obj.ptr(), *name));
+        CALLBACK_RETURN_HANDLED(-1 != ::PyObject_DelAttr(obj.ptr(), name.ptr()));
 #endif
     }
 
@@ -531,20 +579,18 @@ void CPythonObject::NamedEnumerator(const v8::PropertyCallbackInfo<v8::Array>& i
 
     CPythonGIL python_gil;
 
+    int flags = CALLBACK_TYPE_FLAGS();
+
     py::object obj = CJavascriptObject::Wrap(info.Holder());
 
     py::list keys;
     bool filter_name = false;
 
-    if (::PySequence_Check(obj.ptr()))
-    {
-        CALLBACK_RETURN_NO_INTERCEPT(v8::Handle<v8::Array>());
-    }
-    else if (::PyMapping_Check(obj.ptr()))
+    if (flags & TYPE_MAPPING)
     {
         keys = py::list(py::handle<>(PyMapping_Keys(obj.ptr())));
     }
-    else if (PyGen_CheckExact(obj.ptr()))
+    else if (flags & TYPE_GENERATOR)
     {
         py::object iter(py::handle<>(::PyObject_GetIter(obj.ptr())));
 
@@ -597,11 +643,14 @@ v8::Intercepted CPythonObject::IndexedGetter(uint32_t index, const v8::PropertyC
 
     CPythonGIL python_gil;
 
-    py::object obj = CJavascriptObject::Wrap(info.Holder());
-    if (PyGen_Check(obj.ptr()))
+    int flags = CALLBACK_TYPE_FLAGS();
+
+    if (flags & TYPE_GENERATOR)
         CALLBACK_RETURN_HANDLED(v8::Undefined(info.GetIsolate()));
 
-    if (::PySequence_Check(obj.ptr()))
+    py::object obj = CJavascriptObject::Wrap(info.Holder());
+
+    if (flags & TYPE_SEQUENCE)
     {
         if ((Py_ssize_t) index < ::PySequence_Size(obj.ptr()))
         {
@@ -610,7 +659,7 @@ v8::Intercepted CPythonObject::IndexedGetter(uint32_t index, const v8::PropertyC
             CALLBACK_RETURN_HANDLED(Wrap(ret));
         }
     }
-    else if (::PyMapping_Check(obj.ptr()))
+    else if (flags & TYPE_MAPPING)
     {
         char buf[65];
 
@@ -643,14 +692,16 @@ v8::Intercepted CPythonObject::IndexedSetter(uint32_t index, v8::Local<v8::Value
 
     CPythonGIL python_gil;
 
+    int flags = CALLBACK_TYPE_FLAGS();
+
     py::object obj = CJavascriptObject::Wrap(info.Holder());
 
-    if (::PySequence_Check(obj.ptr()))
+    if (flags & TYPE_SEQUENCE)
     {
         if (::PySequence_SetItem(obj.ptr(), index, CJavascriptObject::Wrap(value).ptr()) < 0)
             info.GetIsolate()->ThrowException(v8::Exception::Error(v8::String::NewFromUtf8(info.GetIsolate(), "fail to set indexed value").ToLocalChecked()));
     }
-    else if (::PyMapping_Check(obj.ptr()))
+    else if (flags & TYPE_MAPPING)
     {
         char buf[65];
 
@@ -672,19 +723,21 @@ v8::Intercepted CPythonObject::IndexedQuery(uint32_t index, const v8::PropertyCa
 
     CPythonGIL python_gil;
 
-    py::object obj = CJavascriptObject::Wrap(info.Holder());
+    int flags = CALLBACK_TYPE_FLAGS();
 
-    if (PyGen_Check(obj.ptr()))
+    if (flags & TYPE_GENERATOR)
         CALLBACK_RETURN_HANDLED(v8::Integer::New(info.GetIsolate(), v8::ReadOnly));
 
-    if (::PySequence_Check(obj.ptr()))
+    py::object obj = CJavascriptObject::Wrap(info.Holder());
+
+    if (flags & TYPE_SEQUENCE)
     {
         if ((Py_ssize_t) index < ::PySequence_Size(obj.ptr()))
         {
             CALLBACK_RETURN_HANDLED(v8::Integer::New(info.GetIsolate(), v8::None));
         }
     }
-    else if (::PyMapping_Check(obj.ptr()))
+    else if (flags & TYPE_MAPPING)
     {
         char buf[65];
         int rc;
@@ -717,13 +770,15 @@ v8::Intercepted CPythonObject::IndexedDeleter(uint32_t index, const v8::Property
 
     CPythonGIL python_gil;
 
+    int flags = CALLBACK_TYPE_FLAGS();
+
     py::object obj = CJavascriptObject::Wrap(info.Holder());
 
-    if (::PySequence_Check(obj.ptr()) && (Py_ssize_t) index < ::PySequence_Size(obj.ptr()))
+    if ((flags & TYPE_SEQUENCE) && (Py_ssize_t) index < ::PySequence_Size(obj.ptr()))
     {
         CALLBACK_RETURN_HANDLED(0 <= ::PySequence_DelItem(obj.ptr(), index));
     }
-    else if (::PyMapping_Check(obj.ptr()))
+    else if (flags & TYPE_MAPPING)
     {
         char buf[65];
 
@@ -746,7 +801,7 @@ void CPythonObject::IndexedEnumerator(const v8::PropertyCallbackInfo<v8::Array>&
 
     py::object obj = CJavascriptObject::Wrap(info.Holder());
 
-    Py_ssize_t len = ::PySequence_Check(obj.ptr()) ? ::PySequence_Size(obj.ptr()) : 0;
+    Py_ssize_t len = (CALLBACK_TYPE_FLAGS() & TYPE_SEQUENCE) ? ::PySequence_Size(obj.ptr()) : 0;
 
     v8::Handle<v8::Array> result = v8::Array::New(info.GetIsolate(), len);
 
@@ -762,30 +817,51 @@ void CPythonObject::IndexedEnumerator(const v8::PropertyCallbackInfo<v8::Array>&
     END_HANDLE_EXCEPTION_NO_INTERCEPT(v8::Handle<v8::Array>())
 }
 
-#define GEN_ARG(z, n, data) CJavascriptObject::Wrap(info[n])
-#define GEN_ARGS(count) BOOST_PP_ENUM(count, GEN_ARG, NULL)
+// Arguments of a Javascript to Python call, laid out for PyObject_Vectorcall
+//
+// The common arities stay on the stack, and a spare slot in front of the arguments lets
+// the callee prepend its bound self without copying them (PY_VECTORCALL_ARGUMENTS_OFFSET).
+class CPythonArgs
+{
+    static const size_t SMALL_ARGS = 8;
+
+    PyObject *m_small[SMALL_ARGS + 1];
+    std::unique_ptr<PyObject *[]> m_large;
+
+    PyObject **m_args;
+    size_t m_count;
+public:
+    CPythonArgs(size_t size) : m_args(m_small), m_count(0)
+    {
+        if (size > SMALL_ARGS)
+        {
+            m_large.reset(new PyObject *[size + 1]);
+            m_args = m_large.get();
+        }
 
-#define GEN_CASE_PRED(r, state) \
-  BOOST_PP_NOT_EQUAL( \
-    BOOST_PP_TUPLE_ELEM(2, 0, state), \
-    BOOST_PP_INC(BOOST_PP_TUPLE_ELEM(2, 1, state)) \
-  ) \
-  /**/
+        m_args[0] = NULL;
+    }
+    ~CPythonArgs(void)
+    {
+        for (size_t i=1; i<=m_count; i++)
+        {
+            Py_DECREF(m_args[i]);
+        }
+    }
 
-#define GEN_CASE_OP(r, state) \
-  ( \
-    BOOST_PP_INC(BOOST_PP_TUPLE_ELEM(2, 0, state)), \
-    BOOST_PP_TUPLE_ELEM(2, 1, state) \
-  ) \
-  /**/
+    void Append(py::object arg)
+    {
+        m_args[++m_count] = py::incref(arg.ptr());
+    }
 
-#define GEN_CASE_MACRO(r, state) \
-  case BOOST_PP_TUPLE_ELEM(2, 0, state): { \
-    result = self(GEN_ARGS(BOOST_PP_TUPLE_ELEM(2, 0, state))); \
-    break; \
-  } \
-  /**/
+    py::object Call(py::object callable)
+    {
+        PyObject *result = ::PyObject_Vectorcall(callable.ptr(), m_args + 1,
+                                                 m_count | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
 
+        return py::object(py::handle<>(result));
+    }
+};
 
 void CPythonObject::Caller(const v8::FunctionCallbackInfo<v8::Value>& info)
 {
@@ -797,70 +873,171 @@ void CPythonObject::Caller(const v8::FunctionCallbackInfo<v8::Value>& info)
 
     py::object self;
 
-    if (!info.Data().IsEmpty() && info.Data()->IsExternal())
+    if (!info.Data().IsEmpty() && info.Data()->IsSymbol())
     {
-        v8::Handle<v8::External> field = v8::Handle<v8::External>::Cast(info.Data());
+        const CFunctionCache::CEntry *entry = CIsolateData::Get(info.GetIsolate())->GetFunctionCache().Find(info.Data());
+
+        if (!entry)
+            throw CJavascriptException("the Python function is not available in this isolate", ::PyExc_ReferenceError);
 
-        self = *static_cast<py::object *>(field->Value());
+        self = entry->callable;
     }
     else
     {
         self = CJavascriptObject::Wrap(info.This());
     }
 
-    py::object result;
+    CPythonArgs args(info.Length());
 
-    switch (info.Length())
+    for (int i=0; i<info.Length(); i++)
     {
-        BOOST_PP_FOR((0, 10), GEN_CASE_PRED, GEN_CASE_OP, GEN_CASE_MACRO)
-    default:
-        info.GetIsolate()->ThrowException(v8::Exception::Error(v8::String::NewFromUtf8(info.GetIsolate(), "too many arguments").ToLocalChecked()));
-
-        CALLBACK_RETURN_NO_INTERCEPT(v8::Undefined(info.GetIsolate()));
+        args.Append(CJavascriptObject::Wrap(info[i]));
     }
 
+    py::object result = args.Call(self);
+
     CALLBACK_RETURN_NO_INTERCEPT(Wrap(result));
 
     END_HANDLE_EXCEPTION_NO_INTERCEPT(v8::Undefined(info.GetIsolate()))
 }
 
-void CPythonObject::SetupObjectTemplate(v8::Isolate *isolate, v8::Handle<v8::ObjectTemplate> clazz)
+int CPythonObject::GetTypeFlags(PyTypeObject *type)
+{
+    int flags = 0;
+
+    if (::PyType_IsSubtype(type, &::PyGen_Type))
+        flags |= TYPE_GENERATOR;
+
+    // the same tests as PySequence_Check and PyMapping_Check, which only depend on the type
+    if (!::PyType_IsSubtype(type, &::PyDict_Type) && type->tp_as_sequence && type->tp_as_sequence->sq_item)
+        flags |= TYPE_SEQUENCE;
+    if (type->tp_as_mapping && type->tp_as_mapping->mp_subscript)
+        flags |= TYPE_MAPPING;
+
+    return flags;
+}
+
+void CPythonObject::SetupObjectTemplate(v8::Isolate *isolate, v8::Handle<v8::ObjectTemplate> clazz, int flags)
 {
     v8::HandleScope handle_scope(isolate);
 
+    v8::Local<v8::Integer> data = v8::Integer::New(isolate, flags);
+
     clazz->SetInternalFieldCount(1);
 
+    // the keys of a sequence are its indexes only
     clazz->SetHandler(v8::NamedPropertyHandlerConfiguration(
                           NamedGetter,
                           NamedSetter,
                           NamedQuery,
                           NamedDeleter,
-                          NamedEnumerator)
+                          (flags & TYPE_SEQUENCE) ? NULL : NamedEnumerator,
+                          data)
                      );
 
-    clazz->SetHandler(v8::IndexedPropertyHandlerConfiguration(
-                          IndexedGetter,
-                          IndexedSetter,
-                          IndexedQuery,
-                          IndexedDeleter,
-                          IndexedEnumerator
-                      )
-                     );
+    // a plain object keeps its indexed properties on the Javascript side
+    if (flags & (TYPE_GENERATOR | TYPE_SEQUENCE | TYPE_MAPPING))
+    {
+        clazz->SetHandler(v8::IndexedPropertyHandlerConfiguration(
+                              IndexedGetter,
+                              IndexedSetter,
+                              IndexedQuery,
+                              IndexedDeleter,
+                              IndexedEnumerator,
+                              data
+                          )
+                         );
+    }
 
     clazz->SetCallAsFunctionHandler(Caller);
 }
 
-v8::Handle<v8::ObjectTemplate> CPythonObject::CreateObjectTemplate(v8::Isolate *isolate)
+v8::Handle<v8::ObjectTemplate> CPythonObject::CreateObjectTemplate(v8::Isolate *isolate, int flags)
 {
     v8::EscapableHandleScope handle_scope(isolate);
 
     v8::Local<v8::ObjectTemplate> clazz = v8::ObjectTemplate::New(isolate);
 
-    SetupObjectTemplate(isolate, clazz);
+    SetupObjectTemplate(isolate, clazz, flags);
 
     return handle_scope.Escape(clazz);
 }
 
+v8::MaybeLocal<v8::Function> CPythonObject::CreateFunction(v8::Isolate *isolate, py::object callable, v8::Handle<v8::Symbol> tag)
+{
+    v8::EscapableHandleScope handle_scope(isolate);
+
+    v8::Local<v8::Function> func;
+
+    if (!v8::Function::New(isolate->GetCurrentContext(), Caller, tag).ToLocal(&func))
+        return v8::MaybeLocal<v8::Function>();
+
+    if (PyType_Check(callable.ptr()))
+    {
+        v8::Handle<v8::String> cls_name = v8::String::NewFromUtf8(isolate, py::extract<const char *>(callable.attr("__name__"))()).ToLocalChecked();
+
+        func->SetName(cls_name);
+    }
+
+    return handle_scope.Escape(func);
+}
+
+const intptr_t *CPythonObject::GetExternalReferences(void)
+{
+    static const intptr_t s_references[] = {
+        reinterpret_cast<intptr_t>(NamedGetter),
+        reinterpret_cast<intptr_t>(NamedSetter),
+        reinterpret_cast<intptr_t>(NamedQuery),
+        reinterpret_cast<intptr_t>(NamedDeleter),
+        reinterpret_cast<intptr_t>(NamedEnumerator),
+        reinterpret_cast<intptr_t>(IndexedGetter),
+        reinterpret_cast<intptr_t>(IndexedSetter),
+        reinterpret_cast<intptr_t>(IndexedQuery),
+        reinterpret_cast<intptr_t>(IndexedDeleter),
+        reinterpret_cast<intptr_t>(IndexedEnumerator),
+        reinterpret_cast<intptr_t>(Caller),
+        0
+    };
+
+    return s_references;
+}
+
+v8::StartupData CPythonObject::SerializeInternalField(v8::Local<v8::Object> holder, int index, void *data)
+{
+    // only the global object of the snapshot context can be bound again on deserialization,
+    // every other Python object is lost and restored as None
+    py::object *object = static_cast<py::object *>(holder->GetAlignedPointerFromInternalField(index));
+
+    char *payload = new char[1];
+
+    payload[0] = (object && object->ptr() == static_cast<PyObject *>(data)) ? SNAPSHOT_GLOBAL : SNAPSHOT_NONE;
+
+    return { payload, 1 };
+}
+
+void CPythonObject::DeserializeInternalField(v8::Local<v8::Object> holder, int index, v8::StartupData payload, void *data)
+{
+    CPythonGIL python_gil;
+
+    CDeserializedFields *fields = static_cast<CDeserializedFields *>(data);
+
+    if (payload.raw_size == 1 && payload.data[0] == SNAPSHOT_GLOBAL && !fields->global->is_none())
+    {
+        py::object *object = new py::object(*fields->global);
+
+        holder->SetAlignedPointerInInternalField(index, object);
+
+        fields->wrappers.push_back(std::make_pair(v8::Global<v8::Object>(holder->GetIsolate(), holder), object));
+    }
+    else
+    {
+        // the lost objects are never traced, so they share a None which is never freed
+        static py::object *s_none = new py::object();
+
+        holder->SetAlignedPointerInInternalField(index, s_none);
+    }
+}
+
 bool CPythonObject::IsWrapped(v8::Handle<v8::Object> obj)
 {
     return obj->InternalFieldCount() == 1;
@@ -871,9 +1048,7 @@ py::object CPythonObject::Unwrap(v8::Handle<v8::Object> obj)
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
     v8::HandleScope handle_scope(isolate);
 
-    v8::Handle<v8::External> payload = v8::Handle<v8::External>::Cast(obj->GetInternalField(0));
-
-    return *static_cast<py::object *>(payload->Value());
+    return *static_cast<py::object *>(obj->GetAlignedPointerFromInternalField(0));
 }
 
 void CPythonObject::Dispose(v8::Handle<v8::Value> value)
@@ -954,18 +1129,15 @@ v8::Handle<v8::Value> CPythonObject::WrapInternal(py::object obj)
         }
 
 #ifdef SUPPORT_TRACE_LIFECYCLE
-        static v8::Persistent<v8::ObjectTemplate> s_template(isolate, CreateObjectTemplate(isolate));
-
-        v8::MaybeLocal<v8::Object> instance = v8::Local<v8::ObjectTemplate>::New(
-                isolate, s_template)->NewInstance(
-                        isolate->GetCurrentContext());
+        v8::MaybeLocal<v8::Object> instance = CIsolateData::Get(isolate)->GetWrapperTemplate(Py_TYPE(obj.ptr()))->NewInstance(
+                isolate->GetCurrentContext());
 
         if (!instance.IsEmpty())
         {
             py::object *object = new py::object(obj);
 
             v8::Handle<v8::Object> realInstance = instance.ToLocalChecked();
-            realInstance->SetInternalField(0, v8::External::New(isolate, object));
+            realInstance->SetAlignedPointerInInternalField(0, object);
 
             ObjectTracer::Trace(instance.ToLocalChecked(), object);
         }
@@ -1020,40 +1192,28 @@ v8::Handle<v8::Value> CPythonObject::WrapInternal(py::object obj)
 
         result = v8::Date::New(isolate->GetCurrentContext(), ((double) mktime(&ts)) * 1000 + ms / 1000).ToLocalChecked();
     }
+    else if (PyByteArray_Check(obj.ptr()) ||
+             (PyMemoryView_Check(obj.ptr()) && ::PyBuffer_IsContiguous(PyMemoryView_GET_BUFFER(obj.ptr()), 'C')))
+    {
+        // a strided view can't back an ArrayBuffer, it is wrapped like any other object
+        result = CJavascriptBuffer::WrapPython(obj);
+    }
     else if (PyCFunction_Check(obj.ptr()) || PyFunction_Check(obj.ptr()) || PyMethod_Check(obj.ptr()) || PyType_Check(obj.ptr()))
     {
-        v8::Handle<v8::FunctionTemplate> func_tmpl = v8::FunctionTemplate::New(isolate);
-        py::object *object = new py::object(obj);
-
-        func_tmpl->SetCallHandler(Caller, v8::External::New(isolate, object));
-
-        if (PyType_Check(obj.ptr()))
-        {
-            v8::Handle<v8::String> cls_name = v8::String::NewFromUtf8(isolate, py::extract<const char *>(obj.attr("__name__"))()).ToLocalChecked();
-
-            func_tmpl->SetClassName(cls_name);
-        }
-
-        result = func_tmpl->GetFunction(isolate->GetCurrentContext()).ToLocalChecked();
-
-#ifdef SUPPORT_TRACE_LIFECYCLE
-        if (!result.IsEmpty()) ObjectTracer::Trace(result, object);
-#endif
+        // the function cache holds the callable as long as its function lives
+        result = WrapCallable(obj);
     }
     else
     {
-        static v8::Persistent<v8::ObjectTemplate> s_template(isolate, CreateObjectTemplate(isolate));
-
-        v8::MaybeLocal<v8::Object> instance = v8::Local<v8::ObjectTemplate>::New(
-                isolate, s_template)->NewInstance(
-                        isolate->GetCurrentContext());
+        v8::MaybeLocal<v8::Object> instance = CIsolateData::Get(isolate)->GetWrapperTemplate(Py_TYPE(obj.ptr()))->NewInstance(
+                isolate->GetCurrentContext());
 
         if (!instance.IsEmpty())
         {
             py::object *object = new py::object(obj);
 
             v8::Handle<v8::Object> realInstance = instance.ToLocalChecked();
-            realInstance->SetInternalField(0, v8::External::New(isolate, object));
+            realInstance->SetAlignedPointerInInternalField(0, object);
 
 #ifdef SUPPORT_TRACE_LIFECYCLE
             ObjectTracer::Trace(instance.ToLocalChecked(), object);
@@ -1069,6 +1229,166 @@ v8::Handle<v8::Value> CPythonObject::WrapInternal(py::object obj)
     return handle_scope.Escape(result);
 }
 
+// An int32 becomes a small integer, any other int a double, or raises OverflowError past its range
+static v8::Local<v8::Value> WrapLong(v8::Isolate *isolate, PyObject *obj)
+{
+    int overflow = 0;
+    long value = ::PyLong_AsLongAndOverflow(obj, &overflow);
+
+    if (!overflow && value >= INT32_MIN && value <= INT32_MAX) return v8::Integer::New(isolate, (int32_t) value);
+
+    double number = ::PyLong_AsDouble(obj);
+
+    if (number == -1.0 && ::PyErr_Occurred()) py::throw_error_already_set();
+
+    return v8::Number::New(isolate, number);
+}
+
+namespace {
+
+// Builds the native Javascript copy of a tree of Python containers. The objects get their
+// properties one by one, so they share the hidden classes of the same layouts and stay in
+// fast mode; a cycle can't be copied and raises a TypeError.
+class CPythonCopier
+{
+    v8::Isolate *m_isolate;
+    v8::Local<v8::Context> m_context;
+
+    std::vector<PyObject *> m_parents; // the containers being copied
+
+    class CParentScope
+    {
+        CPythonCopier& m_copier;
+    public:
+        CParentScope(CPythonCopier& copier, PyObject *obj) : m_copier(copier)
+        {
+            if (std::find(copier.m_parents.begin(), copier.m_parents.end(), obj) != copier.m_parents.end())
+            {
+                throw CJavascriptException("cannot copy a cyclic structure to Javascript", ::PyExc_TypeError);
+            }
+
+            if (::Py_EnterRecursiveCall(" while copying a Python object to Javascript")) py::throw_error_already_set();
+
+            copier.m_parents.push_back(obj);
+        }
+
+        ~CParentScope()
+        {
+            m_copier.m_parents.pop_back();
+
+            ::Py_LeaveRecursiveCall();
+        }
+    };
+
+    v8::Local<v8::Value> CopySequence(PyObject *obj)
+    {
+        v8::EscapableHandleScope handle_scope(m_isolate);
+
+        CParentScope parent_scope(*this, obj);
+
+        // wrapping an item may run Python code which changes the list, so its items are held
+        // by a tuple while they are copied
+        py::object items(py::handle<>(PyList_Check(obj) ? ::PyList_AsTuple(obj) : py::incref(obj)));
+
+        Py_ssize_t size = PyTuple_GET_SIZE(items.ptr());
+
+        std::vector<v8::Local<v8::Value> > elements(size);
+
+        for (Py_ssize_t i=0; i<size; i++) elements[i] = Copy(PyTuple_GET_ITEM(items.ptr(), i));
+
+        return handle_scope.Escape(v8::Array::New(m_isolate, elements.data(), elements.size()));
+    }
+
+    v8::Local<v8::Value> CopyDict(PyObject *obj)
+    {
+        v8::EscapableHandleScope handle_scope(m_isolate);
+
+        CParentScope parent_scope(*this, obj);
+
+        v8::Local<v8::Object> result = v8::Object::New(m_isolate);
+
+        // the same for the keys and values of a dict, held by a list of pairs
+        py::object items(py::handle<>(::PyDict_Items(obj)));
+
+        for (Py_ssize_t i=0; i<PyList_GET_SIZE(items.ptr()); i++)
+        {
+            PyObject *key = PyTuple_GET_ITEM(PyList_GET_ITEM(items.ptr(), i), 0);
+            PyObject *value = PyTuple_GET_ITEM(PyList_GET_ITEM(items.ptr(), i), 1);
+
+            if (!PyUnicode_Check(key)) throw CJavascriptException("the keys of a copied dict must be str", ::PyExc_TypeError);
+
+            v8::Local<v8::String> name = ToString(py::object(py::handle<>(py::borrowed(key))));
+
+            if (result->CreateDataProperty(m_context, name, Copy(value)).IsNothing())
+            {
+                throw CJavascriptException("fail to copy the dict to Javascript", ::PyExc_RuntimeError);
+            }
+        }
+
+        return handle_scope.Escape(result);
+    }
+public:
+    CPythonCopier(v8::Isolate *isolate) : m_isolate(isolate), m_context(isolate->GetCurrentContext())
+    {
+    }
+
+    v8::Local<v8::Value> Copy(PyObject *obj)
+    {
+        if (obj == Py_None) return v8::Null(m_isolate);
+        if (PyBool_Check(obj)) return v8::Boolean::New(m_isolate, obj == Py_True);
+
+        if (PyLong_CheckExact(obj)) return WrapLong(m_isolate, obj);
+
+        if (PyFloat_CheckExact(obj)) return v8::Number::New(m_isolate, PyFloat_AS_DOUBLE(obj));
+
+        if (PyUnicode_CheckExact(obj) || PyBytes_CheckExact(obj))
+        {
+            return ToString(py::object(py::handle<>(py::borrowed(obj))));
+        }
+
+        if (PyDict_Check(obj)) return CopyDict(obj);
+        if (PyList_Check(obj) || PyTuple_Check(obj)) return CopySequence(obj);
+
+        return CPythonObject::Wrap(py::object(py::handle<>(py::borrowed(obj))));
+    }
+};
+
+}
+
+v8::Handle<v8::Value> CPythonObject::Copy(py::object obj)
+{
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    assert(isolate->InContext());
+
+    v8::EscapableHandleScope handle_scope(isolate);
+
+    CPythonGIL python_gil;
+
+    CPythonCopier copier(isolate);
+
+    return handle_scope.Escape(copier.Copy(obj.ptr()));
+}
+
+v8::Handle<v8::Value> CPythonObject::WrapCallable(py::object obj)
+{
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::EscapableHandleScope handle_scope(isolate);
+    v8::TryCatch try_catch(isolate);
+
+    // a new bound method is created on each attribute access, the cache keys it by its
+    // function and receiver, and the function calls it with the receiver it is bound to
+    v8::Local<v8::Function> func;
+
+    if (!CIsolateData::Get(isolate)->GetFunctionCache().Get(obj).ToLocal(&func))
+    {
+        CJavascriptException::ThrowIf(isolate, try_catch);
+
+        throw CJavascriptException("fail to create the function of a Python callable", ::PyExc_RuntimeError);
+    }
+
+    return handle_scope.Escape(func);
+}
+
 void CJavascriptObject::CheckAttr(v8::Handle<v8::String> name) const
 {
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
@@ -1199,71 +1519,258 @@ CJavascriptObjectPtr CJavascriptObject::Clone(void)
     return CJavascriptObjectPtr(new CJavascriptObject(Object()->Clone()));
 }
 
-bool CJavascriptObject::Contains(const std::string& name)
+namespace {
+
+// Walks a Javascript object graph and builds its plain Python copy. The arrays become lists
+// and the other ordinary objects dicts of their own enumerable properties; the functions, the
+// wrapped Python objects and the objects with an internal state are wrapped as usual.
+//
+// An object reached twice converts to the same dict or list, so the shared references and
+// the cycles of the graph are preserved.
+class CJavascriptConverter
 {
-    v8::Isolate* isolate = v8::Isolate::GetCurrent();
-    v8::HandleScope handle_scope(isolate);
+    struct CVisit
+    {
+        v8::Global<v8::Object> obj;
+        py::object converted;
+    };
 
-    CHECK_V8_CONTEXT();
+    v8::Isolate *m_isolate;
+    v8::Local<v8::Context> m_context;
+    v8::TryCatch& m_try_catch;
+    CNameCache *m_names;
 
-    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+    int m_depth; // the levels of objects left to convert, negative without limit
 
-    v8::TryCatch try_catch(isolate);
+    std::unordered_multimap<int, CVisit> m_visited;
 
-    bool found = Object()->Has(context, DecodeUtf8(name)).ToChecked();
+    void Throw(void)
+    {
+        CJavascriptException::ThrowIf(m_isolate, m_try_catch);
 
-    if (try_catch.HasCaught()) CJavascriptException::ThrowIf(isolate, try_catch);
+        throw CJavascriptException("execution is terminating", ::PyExc_RuntimeError);
+    }
 
-    return found;
-}
+    bool IsPlain(v8::Local<v8::Object> obj) const
+    {
+        return !(obj->IsFunction() || obj->IsDate() || obj->IsRegExp() || obj->IsProxy() ||
+                 obj->IsStringObject() || obj->IsNumberObject() || obj->IsBooleanObject() ||
+                 obj->IsMap() || obj->IsSet() || obj->IsWeakMap() || obj->IsWeakSet() || obj->IsPromise() ||
+                 obj->IsArrayBuffer() || obj->IsArrayBufferView() || obj->IsSharedArrayBuffer() ||
+                 CPythonObject::IsWrapped(obj));
+    }
 
-bool CJavascriptObject::Equals(CJavascriptObjectPtr other) const
-{
-    v8::Isolate* isolate = v8::Isolate::GetCurrent();
-    v8::HandleScope handle_scope(isolate);
+    PyObject *Find(v8::Local<v8::Object> obj) const
+    {
+        auto range = m_visited.equal_range(obj->GetIdentityHash());
 
-    CHECK_V8_CONTEXT();
+        for (auto it = range.first; it != range.second; it++)
+        {
+            if (it->second.obj == obj) return it->second.converted.ptr();
+        }
 
-    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+        return NULL;
+    }
 
-    return other.get() && Object()->Equals(context, other->Object()).ToChecked();
-}
+    void Remember(v8::Local<v8::Object> obj, py::object converted)
+    {
+        CVisit& visit = m_visited.emplace(obj->GetIdentityHash(), CVisit())->second;
 
-void CJavascriptObject::Dump(std::ostream& os) const
-{
-    v8::Isolate* isolate = v8::Isolate::GetCurrent();
-    v8::HandleScope handle_scope(isolate);
+        visit.obj.Reset(m_isolate, obj);
+        visit.converted = converted;
+    }
 
-    CHECK_V8_CONTEXT();
+    py::object ConvertArray(v8::Local<v8::Array> array)
+    {
+        py::list items;
 
-    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+        Remember(array, items);
 
-    if (m_obj.IsEmpty())
-        os << "None";
-    else if (Object()->IsInt32())
-        os << Object()->Int32Value(context).ToChecked();
-    else if (Object()->IsNumber())
-        os << Object()->NumberValue(context).ToChecked();
-    else if (Object()->IsBoolean())
-        os << Object()->BooleanValue(isolate);
-    else if (Object()->IsNull())
-        os << "None";
-    else if (Object()->IsUndefined())
-        os << "N/A";
-    else if (Object()->IsString())
-        os << *v8::String::Utf8Value(isolate, v8::Handle<v8::String>::Cast(Object()));
-    else
-    {
-        v8::MaybeLocal<v8::String> s = Object()->ToString(context);
-        if(s.IsEmpty())
-            s = Object()->ObjectProtoToString(context);
+        for (uint32_t i=0; i<array->Length(); i++)
+        {
+            v8::Local<v8::Value> value;
 
-        if(!s.IsEmpty())
-            os << *v8::String::Utf8Value(isolate, s.ToLocalChecked());
-    }
-}
+            if (!array->Get(m_context, i).ToLocal(&value)) Throw();
 
-CJavascriptObject::operator long() const
+            items.append(Convert(value));
+        }
+
+        return std::move(items);
+    }
+
+    py::object ConvertObject(v8::Local<v8::Object> obj)
+    {
+        py::dict attrs;
+
+        Remember(obj, attrs);
+
+        v8::Local<v8::Array> names;
+
+        if (!obj->GetOwnPropertyNames(m_context, static_cast<v8::PropertyFilter>(v8::ONLY_ENUMERABLE | v8::SKIP_SYMBOLS),
+                                      v8::KeyConversionMode::kConvertToString).ToLocal(&names)) Throw();
+
+        for (uint32_t i=0; i<names->Length(); i++)
+        {
+            v8::Local<v8::Value> name, value;
+
+            if (!names->Get(m_context, i).ToLocal(&name) || !obj->Get(m_context, name).ToLocal(&value)) Throw();
+
+            // the keys are interned, like the attribute names of the Python objects
+            py::object key = m_names->Get(name.As<v8::Name>());
+
+            if (0 > ::PyDict_SetItem(attrs.ptr(), key.ptr(), Convert(value).ptr())) py::throw_error_already_set();
+        }
+
+        return std::move(attrs);
+    }
+public:
+    CJavascriptConverter(v8::Isolate *isolate, v8::TryCatch& try_catch, int depth)
+        : m_isolate(isolate), m_context(isolate->GetCurrentContext()), m_try_catch(try_catch),
+          m_names(&CIsolateData::Get(isolate)->GetNameCache()), m_depth(depth)
+    {
+    }
+
+    py::object Convert(v8::Local<v8::Value> value)
+    {
+        if (value->IsNull() || value->IsUndefined()) return py::object();
+        if (value->IsTrue()) return py::object(py::handle<>(py::borrowed(Py_True)));
+        if (value->IsFalse()) return py::object(py::handle<>(py::borrowed(Py_False)));
+        if (value->IsInt32()) return py::object(py::handle<>(::PyLong_FromLong(value.As<v8::Int32>()->Value())));
+        if (value->IsNumber()) return py::object(py::handle<>(::PyFloat_FromDouble(value.As<v8::Number>()->Value())));
+        if (value->IsString()) return ::ToPython(m_isolate, value.As<v8::String>());
+
+        if (!value->IsObject()) return CJavascriptObject::Wrap(value);
+
+        v8::HandleScope handle_scope(m_isolate);
+
+        v8::Local<v8::Object> obj = value.As<v8::Object>();
+
+        PyObject *converted = Find(obj);
+
+        if (converted) return py::object(py::handle<>(py::borrowed(converted)));
+
+        if (m_depth == 0 || !IsPlain(obj)) return CJavascriptObject::Wrap(value);
+
+        if (::Py_EnterRecursiveCall(" while converting a Javascript object")) py::throw_error_already_set();
+
+        m_depth--;
+
+        try
+        {
+            py::object result = obj->IsArray() ? ConvertArray(obj.As<v8::Array>()) : ConvertObject(obj);
+
+            m_depth++;
+            ::Py_LeaveRecursiveCall();
+
+            return result;
+        }
+        catch (...)
+        {
+            m_depth++;
+            ::Py_LeaveRecursiveCall();
+
+            throw;
+        }
+    }
+};
+
+}
+
+py::object CJavascriptObject::ConvertToPython(py::object depth)
+{
+    ILazyObject *pLazyObject = dynamic_cast<ILazyObject *>(this);
+
+    if (pLazyObject) pLazyObject->LazyConstructor();
+
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+
+    CHECK_V8_CONTEXT();
+
+    int levels = -1;
+
+    if (!depth.is_none())
+    {
+        levels = py::extract<int>(depth);
+
+        if (levels < 0) throw CJavascriptException("depth must be None or a non-negative number", ::PyExc_ValueError);
+    }
+
+    // JSNull and JSUndefined
+    if (m_obj.IsEmpty()) return py::object();
+
+    v8::TryCatch try_catch(isolate);
+
+    CJavascriptConverter converter(isolate, try_catch, levels);
+
+    return converter.Convert(Object());
+}
+
+bool CJavascriptObject::Contains(const std::string& name)
+{
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+
+    CHECK_V8_CONTEXT();
+
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+
+    v8::TryCatch try_catch(isolate);
+
+    bool found = Object()->Has(context, DecodeUtf8(name)).ToChecked();
+
+    if (try_catch.HasCaught()) CJavascriptException::ThrowIf(isolate, try_catch);
+
+    return found;
+}
+
+bool CJavascriptObject::Equals(CJavascriptObjectPtr other) const
+{
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+
+    CHECK_V8_CONTEXT();
+
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+
+    return other.get() && Object()->Equals(context, other->Object()).ToChecked();
+}
+
+void CJavascriptObject::Dump(std::ostream& os) const
+{
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+
+    CHECK_V8_CONTEXT();
+
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+
+    if (m_obj.IsEmpty())
+        os << "None";
+    else if (Object()->IsInt32())
+        os << Object()->Int32Value(context).ToChecked();
+    else if (Object()->IsNumber())
+        os << Object()->NumberValue(context).ToChecked();
+    else if (Object()->IsBoolean())
+        os << Object()->BooleanValue(isolate);
+    else if (Object()->IsNull())
+        os << "None";
+    else if (Object()->IsUndefined())
+        os << "N/A";
+    else if (Object()->IsString())
+        os << *v8::String::Utf8Value(isolate, v8::Handle<v8::String>::Cast(Object()));
+    else
+    {
+        v8::MaybeLocal<v8::String> s = Object()->ToString(context);
+        if(s.IsEmpty())
+            s = Object()->ObjectProtoToString(context);
+
+        if(!s.IsEmpty())
+            os << *v8::String::Utf8Value(isolate, s.ToLocalChecked());
+    }
+}
+
+CJavascriptObject::operator long() const
 {
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
     v8::HandleScope handle_scope(isolate);
@@ -1330,15 +1837,11 @@ py::object CJavascriptObject::Wrap(v8::Handle<v8::Value> value, v8::Handle<v8::O
     }
     if (value->IsString())
     {
-        v8::String::Utf8Value str(isolate, v8::Handle<v8::String>::Cast(value));
-
-        return py::str(*str, str.length());
+        return ToPython(isolate, v8::Handle<v8::String>::Cast(value));
     }
     if (value->IsStringObject())
     {
-        v8::String::Utf8Value str(isolate, value.As<v8::StringObject>()->ValueOf());
-
-        return py::str(*str, str.length());
+        return ToPython(isolate, value.As<v8::StringObject>()->ValueOf());
     }
     if (value->IsBoolean())
     {
@@ -1393,6 +1896,10 @@ py::object CJavascriptObject::Wrap(v8::Handle<v8::Object> obj, v8::Handle<v8::Ob
     {
         return CPythonObject::Unwrap(obj);
     }
+    else if (CJavascriptBuffer::IsBuffer(obj))
+    {
+        return Wrap(new CJavascriptBuffer(obj));
+    }
     else if (obj->IsFunction())
     {
         return Wrap(new CJavascriptFunction(self, v8::Handle<v8::Function>::Cast(obj)));
@@ -1410,6 +1917,35 @@ py::object CJavascriptObject::Wrap(CJavascriptObject *obj)
     return py::object(py::handle<>(boost::python::converter::shared_ptr_to_python<CJavascriptObject>(CJavascriptObjectPtr(obj))));
 }
 
+// Converts Python items to the elements of a new array. The lists of plain ints or floats
+// skip the generic wrapping and produce the Smis or numbers right away.
+static void WrapArrayItems(v8::Isolate *isolate, PyObject *const *items, size_t count,
+                           std::vector<v8::Local<v8::Value> >& elements)
+{
+    bool ints = true, floats = true;
+
+    for (size_t i=0; i<count && (ints || floats); i++)
+    {
+        ints = ints && PyLong_CheckExact(items[i]);
+        floats = floats && PyFloat_CheckExact(items[i]);
+    }
+
+    elements.resize(count);
+
+    if (ints)
+    {
+        for (size_t i=0; i<count; i++) elements[i] = WrapLong(isolate, items[i]);
+    }
+    else if (floats)
+    {
+        for (size_t i=0; i<count; i++) elements[i] = v8::Number::New(isolate, PyFloat_AS_DOUBLE(items[i]));
+    }
+    else
+    {
+        for (size_t i=0; i<count; i++) elements[i] = CPythonObject::Wrap(py::object(py::handle<>(py::borrowed(items[i]))));
+    }
+}
+
 void CJavascriptArray::LazyConstructor(void)
 {
     if (!m_obj.IsEmpty()) return;
@@ -1429,38 +1965,72 @@ void CJavascriptArray::LazyConstructor(void)
         m_size = PyLong_AsLong(m_items.ptr());
         array = v8::Array::New(isolate, m_size);
     }
-    else if (PyList_Check(m_items.ptr()))
+    else if (PyList_Check(m_items.ptr()) || PyTuple_Check(m_items.ptr()))
     {
-        m_size = PyList_GET_SIZE(m_items.ptr());
-        array = v8::Array::New(isolate, m_size);
+        // a tuple holds the items, converting one may run Python code changing the list
+        py::object items(py::handle<>(::PySequence_Tuple(m_items.ptr())));
 
-        for (Py_ssize_t i=0; i< (Py_ssize_t) m_size; i++)
-        {
-            array->Set(context, v8::Uint32::New(isolate, i), CPythonObject::Wrap(py::object(py::handle<>(py::borrowed(PyList_GET_ITEM(m_items.ptr(), i))))));
-        }
-    }
-    else if (PyTuple_Check(m_items.ptr()))
-    {
-        m_size = PyTuple_GET_SIZE(m_items.ptr());
-        array = v8::Array::New(isolate, m_size);
+        m_size = PyTuple_GET_SIZE(items.ptr());
 
-        for (Py_ssize_t i=0; i< (Py_ssize_t) m_size; i++)
-        {
-            array->Set(context, v8::Uint32::New(isolate, i), CPythonObject::Wrap(py::object(py::handle<>(py::borrowed(PyTuple_GET_ITEM(m_items.ptr(), i))))));
-        }
+        std::vector<v8::Local<v8::Value> > elements;
+
+        WrapArrayItems(isolate, &PyTuple_GET_ITEM(items.ptr(), 0), m_size, elements);
+
+        array = v8::Array::New(isolate, elements.data(), elements.size());
     }
     else if (PyGen_Check(m_items.ptr()))
     {
+        // the items are appended in chunks, so the handles of a long generator don't pile up
+        static const size_t CHUNK_SIZE = 1024;
+
         array = v8::Array::New(isolate);
 
+        v8::TryCatch try_catch(isolate);
+
         py::object iter(py::handle<>(::PyObject_GetIter(m_items.ptr())));
 
+        std::vector<PyObject *> items;
+        std::vector<v8::Local<v8::Value> > elements;
+
+        items.reserve(CHUNK_SIZE);
+
         m_size = 0;
-        PyObject *item = NULL;
 
-        while (NULL != (item = ::PyIter_Next(iter.ptr())))
+        while (true)
         {
-            array->Set(context, v8::Uint32::New(isolate, m_size++), CPythonObject::Wrap(py::object(py::handle<>(py::borrowed(item)))));
+            std::vector<py::object> chunk;
+            PyObject *item = NULL;
+
+            items.clear();
+
+            while (items.size() < CHUNK_SIZE && NULL != (item = ::PyIter_Next(iter.ptr())))
+            {
+                chunk.push_back(py::object(py::handle<>(item)));
+                items.push_back(item);
+            }
+
+            if (::PyErr_Occurred()) py::throw_error_already_set();
+
+            if (items.empty()) break;
+
+            v8::HandleScope chunk_scope(isolate);
+
+            WrapArrayItems(isolate, items.data(), items.size(), elements);
+
+            // own data properties, a script may have replaced Array.prototype.push
+            for (size_t i=0; i<elements.size(); i++)
+            {
+                if (!array->CreateDataProperty(context, (uint32_t) (m_size + i), elements[i]).FromMaybe(false))
+                {
+                    CJavascriptException::ThrowIf(isolate, try_catch);
+
+                    throw CJavascriptException("fail to build the array", ::PyExc_RuntimeError);
+                }
+            }
+
+            m_size += items.size();
+
+            if (items.size() < CHUNK_SIZE) break;
         }
     }
 
@@ -1497,18 +2067,7 @@ py::object CJavascriptArray::GetItem(py::object key)
 
         if (0 == PySlice_GetIndicesEx(PySlice_Cast(key.ptr()), arrayLen, &start, &stop, &step, &sliceLen))
         {
-            py::list slice;
-
-            for (Py_ssize_t idx=start; idx<stop; idx+=step)
-            {
-                v8::Handle<v8::Value> value = Object()->Get(context, v8::Integer::New(isolate, (uint32_t) idx)).ToLocalChecked();
-
-                if (value.IsEmpty()) CJavascriptException::ThrowIf(isolate, try_catch);
-
-                slice.append(CJavascriptObject::Wrap(value, Object()));
-            }
-
-            return std::move(slice);
+            return ReadItems(start, step, sliceLen);
         }
     }
     else if (PyInt_Check(key.ptr()) || PyLong_Check(key.ptr()))
@@ -1527,6 +2086,158 @@ py::object CJavascriptArray::GetItem(py::object key)
     throw CJavascriptException("list indices must be integers", ::PyExc_TypeError);
 }
 
+namespace {
+
+// Collects the elements of an array visited by v8::Array::Iterate. The numbers and the
+// primitive constants are converted right away, since that doesn't allocate on the V8 heap,
+// and the other values are kept alive to be wrapped once the iteration is over.
+struct CArrayReader
+{
+    v8::Isolate *isolate;
+    Py_ssize_t start, step, count;
+
+    PyObject *items; // a list of count slots
+    std::vector<std::pair<Py_ssize_t, v8::Global<v8::Value> > > pending;
+
+    static v8::Array::CallbackResult Visit(uint32_t index, v8::Local<v8::Value> element, void *data)
+    {
+        CArrayReader *reader = static_cast<CArrayReader *>(data);
+
+        // the elements are visited in ascending order, whatever the direction of the slice
+        bool ascending = reader->step > 0;
+
+        Py_ssize_t offset = ascending ? (Py_ssize_t) index - reader->start : reader->start - (Py_ssize_t) index;
+        Py_ssize_t step = ascending ? reader->step : -reader->step;
+
+        if (offset < 0) return ascending ? v8::Array::CallbackResult::kContinue : v8::Array::CallbackResult::kBreak;
+        if (offset % step) return v8::Array::CallbackResult::kContinue;
+
+        Py_ssize_t pos = offset / step;
+
+        if (pos >= reader->count) return ascending ? v8::Array::CallbackResult::kBreak : v8::Array::CallbackResult::kContinue;
+
+        PyObject *item = NULL;
+
+        if (element->IsNull() || element->IsUndefined())
+        {
+            item = py::incref(Py_None);
+        }
+        else if (element->IsTrue() || element->IsFalse())
+        {
+            item = PyBool_FromLong(element->IsTrue());
+        }
+        else if (element->IsInt32())
+        {
+            item = ::PyLong_FromLong(element.As<v8::Int32>()->Value());
+        }
+        else if (element->IsNumber())
+        {
+            item = ::PyFloat_FromDouble(element.As<v8::Number>()->Value());
+        }
+        else
+        {
+            reader->pending.emplace_back(pos, v8::Global<v8::Value>(reader->isolate, element));
+
+            return v8::Array::CallbackResult::kContinue;
+        }
+
+        if (!item) return v8::Array::CallbackResult::kException;
+
+        PyList_SET_ITEM(reader->items, pos, item);
+
+        return v8::Array::CallbackResult::kContinue;
+    }
+};
+
+}
+
+py::list CJavascriptArray::ReadItems(Py_ssize_t start, Py_ssize_t step, Py_ssize_t count)
+{
+    LazyConstructor();
+
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+
+    CHECK_V8_CONTEXT();
+
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+
+    v8::TryCatch try_catch(isolate);
+
+    // the slots are filled in place, a py::list built from a handle would copy the new list
+    py::list items(py::detail::new_reference(py::expect_non_null(::PyList_New(count))));
+
+    if (count == 0) return items;
+
+    CArrayReader reader = { isolate, start, step, count, items.ptr() };
+
+    if (v8::Handle<v8::Array>::Cast(Object())->Iterate(context, &CArrayReader::Visit, &reader).IsNothing())
+    {
+        if (::PyErr_Occurred()) py::throw_error_already_set();
+
+        CJavascriptException::ThrowIf(isolate, try_catch);
+    }
+
+    static const size_t CHUNK_SIZE = 1024;
+
+    for (size_t i=0; i<reader.pending.size(); i+=CHUNK_SIZE)
+    {
+        v8::HandleScope chunk_scope(isolate);
+
+        for (size_t j=i; j<std::min(i + CHUNK_SIZE, reader.pending.size()); j++)
+        {
+            py::object item = CJavascriptObject::Wrap(reader.pending[j].second.Get(isolate), Object());
+
+            reader.pending[j].second.Reset();
+
+            PyList_SET_ITEM(items.ptr(), reader.pending[j].first, py::incref(item.ptr()));
+        }
+    }
+
+    // the elements past the end of an array shrunk by a getter
+    for (Py_ssize_t i=0; i<count; i++)
+    {
+        if (!PyList_GET_ITEM(items.ptr(), i)) PyList_SET_ITEM(items.ptr(), i, py::incref(Py_None));
+    }
+
+    return items;
+}
+
+py::list CJavascriptArray::ToList(void)
+{
+    return ReadItems(0, 1, Length());
+}
+
+py::object CJavascriptArray::Iter(py::object self)
+{
+    return py::object(CJavascriptArrayIterator(self));
+}
+
+py::object CJavascriptArrayIterator::Next(void)
+{
+    if (m_index >= (size_t) PyList_GET_SIZE(m_window.ptr()))
+    {
+        CJavascriptArray& array = py::extract<CJavascriptArray&>(m_array);
+
+        // the length is read again for each window, the array may change while it is iterated
+        size_t length = array.Length();
+
+        if (m_pos >= length)
+        {
+            ::PyErr_SetNone(::PyExc_StopIteration);
+            py::throw_error_already_set();
+        }
+
+        m_window = array.ReadItems(m_pos, 1, std::min(m_window_size, length - m_pos));
+        m_window_size = std::min(m_window_size * 2, MAX_WINDOW_SIZE);
+        m_index = 0;
+    }
+
+    m_pos++;
+
+    return py::object(py::handle<>(py::borrowed(PyList_GET_ITEM(m_window.ptr(), m_index++))));
+}
+
 py::object CJavascriptArray::SetItem(py::object key, py::object value)
 {
     LazyConstructor();
@@ -1722,132 +2433,430 @@ py::object CJavascriptFunction::CallWithArgs(py::tuple args, py::dict kwds)
     v8::TryCatch try_catch(isolate);
 
     CJavascriptFunction& func = extractor();
-    py::list argv(args.slice(1, py::_));
 
-    return func.Call(func.Self(), argv, kwds);
+    return func.Call(func.Self(), &PyTuple_GET_ITEM(args.ptr(), 1), argc - 1, kwds.ptr());
+}
+
+PyObject *CJavascriptFunction::CallFunction(PyObject *callable, PyObject *args, PyObject *kwds)
+{
+    try
+    {
+        void *func = py::converter::get_lvalue_from_python(callable, py::converter::registered<CJavascriptFunction>::converters);
+
+        if (!func) throw CJavascriptException("missed self argument", ::PyExc_TypeError);
+
+        v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+
+        CJavascriptFunction& self = *static_cast<CJavascriptFunction *>(func);
+
+        py::object result = self.Call(self.Self(), &PyTuple_GET_ITEM(args, 0), PyTuple_GET_SIZE(args), kwds);
+
+        return py::incref(result.ptr());
+    }
+    catch (...)
+    {
+        py::handle_exception();
+
+        return NULL;
+    }
+}
+
+py::object CJavascriptFunction::Call(v8::Handle<v8::Object> self, py::list args, py::dict kwds)
+{
+    // the items of a tuple can't be dropped by the Python code run while they are converted
+    py::tuple items(py::handle<>(::PyList_AsTuple(args.ptr())));
+
+    return Call(self, &PyTuple_GET_ITEM(items.ptr(), 0), PyTuple_GET_SIZE(items.ptr()), kwds.ptr());
+}
+
+// Arguments of a Python to Javascript call, converted straight into a handle buffer
+// which stays on the stack for the common arities
+class CJavascriptArgs
+{
+    static const size_t SMALL_ARGS = 8;
+
+    v8::Local<v8::Value> m_small[SMALL_ARGS];
+    std::unique_ptr<v8::Local<v8::Value>[]> m_large;
+
+    v8::Local<v8::Value> *m_argv;
+    size_t m_argc;
+public:
+    CJavascriptArgs(PyObject *const *args, size_t nargs, PyObject *kwds)
+        : m_argv(m_small), m_argc(0)
+    {
+        // the keyword values follow the positional arguments, in the order of the dict, which is
+        // copied first since converting a value may run Python code changing the dict
+        py::object values;
+
+        if (kwds && ::PyDict_Size(kwds) > 0) values = py::object(py::handle<>(::PyDict_Values(kwds)));
+
+        size_t nvalues = values.is_none() ? 0 : PyList_GET_SIZE(values.ptr());
+
+        if (nargs + nvalues > SMALL_ARGS)
+        {
+            m_large.reset(new v8::Local<v8::Value>[nargs + nvalues]);
+            m_argv = m_large.get();
+        }
+
+        for (size_t i=0; i<nargs; i++)
+        {
+            m_argv[m_argc++] = CPythonObject::Wrap(py::object(py::handle<>(py::borrowed(args[i]))));
+        }
+
+        for (size_t i=0; i<nvalues; i++)
+        {
+            m_argv[m_argc++] = CPythonObject::Wrap(py::object(py::handle<>(py::borrowed(PyList_GET_ITEM(values.ptr(), i)))));
+        }
+    }
+
+    int Count(void) const {
+        return (int) m_argc;
+    }
+    v8::Local<v8::Value> *Values(void) {
+        return m_argc ? m_argv : NULL;
+    }
+};
+
+py::object CJavascriptFunction::Call(v8::Handle<v8::Object> self, PyObject *const *args, size_t nargs, PyObject *kwds)
+{
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+
+    CHECK_V8_CONTEXT();
+
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+
+    v8::TryCatch try_catch(isolate);
+
+    v8::Handle<v8::Function> func = v8::Handle<v8::Function>::Cast(Object());
+
+    CJavascriptArgs argv(args, nargs, kwds);
+
+    v8::MaybeLocal<v8::Value> result;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    result = func->Call(context,
+                        self.IsEmpty() ? isolate->GetCurrentContext()->Global() : self,
+                        argv.Count(), argv.Values());
+
+    Py_END_ALLOW_THREADS
+
+    if (result.IsEmpty()) CJavascriptException::ThrowIf(isolate, try_catch);
+
+    return CJavascriptObject::Wrap(result.ToLocalChecked());
+}
+
+py::object CJavascriptFunction::CreateWithArgs(CJavascriptFunctionPtr proto, py::tuple args, py::dict kwds)
+{
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+
+    CHECK_V8_CONTEXT();
+
+    if (proto->Object().IsEmpty())
+        throw CJavascriptException("Object prototype may only be an Object", ::PyExc_TypeError);
+
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+
+    v8::TryCatch try_catch(isolate);
+
+    v8::Handle<v8::Function> func = v8::Handle<v8::Function>::Cast(proto->Object());
+
+    size_t args_count = ::PyTuple_Size(args.ptr());
+
+    std::vector< v8::Handle<v8::Value> > params(args_count);
+
+    for (size_t i=0; i<args_count; i++)
+    {
+        params[i] = CPythonObject::Wrap(args[i]);
+    }
+
+    v8::Handle<v8::Object> result;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    result = func->NewInstance(context, params.size(), params.empty() ? NULL : &params[0]).ToLocalChecked();
+
+    Py_END_ALLOW_THREADS
+
+    if (result.IsEmpty()) CJavascriptException::ThrowIf(isolate, try_catch);
+
+    size_t kwds_count = ::PyMapping_Size(kwds.ptr());
+    py::list items = kwds.items();
+
+    for (size_t i=0; i<kwds_count; i++)
+    {
+        py::tuple item(items[i]);
+
+        py::str key(item[0]);
+        py::object value = item[1];
+
+        result->Set(context, ToString(key), CPythonObject::Wrap(value));
+    }
+
+    return CJavascriptObject::Wrap(result);
+}
+
+py::object CJavascriptFunction::ApplyJavascript(CJavascriptObjectPtr self, py::list args, py::dict kwds)
+{
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+    CHECK_V8_CONTEXT();
+
+    return Call(self->Object(), args, kwds);
+}
+
+py::object CJavascriptFunction::ApplyPython(py::object self, py::list args, py::dict kwds)
+{
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+
+    CHECK_V8_CONTEXT();
+
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+
+    return Call(CPythonObject::Wrap(self)->ToObject(context).ToLocalChecked(), args, kwds);
+}
+
+py::object CJavascriptFunction::Invoke(py::list args, py::dict kwds)
+{
+    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
+    CHECK_V8_CONTEXT();
+
+    return Call(Self(), args, kwds);
+}
+
+CJavascriptPreparedCallPtr CJavascriptFunction::Prepare(py::object receiver)
+{
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+
+    CHECK_V8_CONTEXT();
+
+    v8::Handle<v8::Value> self;
+
+    if (!receiver.is_none())
+    {
+        self = CPythonObject::Wrap(receiver);
+    }
+    else if (!m_self.IsEmpty())
+    {
+        self = Self();
+    }
+    else
+    {
+        self = isolate->GetCurrentContext()->Global();
+    }
+
+    return CJavascriptPreparedCallPtr(new CJavascriptPreparedCall(v8::Handle<v8::Function>::Cast(Object()), self));
 }
 
-py::object CJavascriptFunction::Call(v8::Handle<v8::Object> self, py::list args, py::dict kwds)
+py::list CJavascriptFunction::Map(py::object iterable, size_t chunk_size)
 {
     v8::Isolate* isolate = v8::Isolate::GetCurrent();
     v8::HandleScope handle_scope(isolate);
 
     CHECK_V8_CONTEXT();
 
-    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+    if (chunk_size == 0) throw CJavascriptException("the chunk size must be positive", ::PyExc_ValueError);
 
-    v8::TryCatch try_catch(isolate);
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
 
     v8::Handle<v8::Function> func = v8::Handle<v8::Function>::Cast(Object());
+    v8::Handle<v8::Object> self = m_self.IsEmpty() ? context->Global() : Self();
 
-    size_t args_count = ::PyList_Size(args.ptr()), kwds_count = ::PyMapping_Size(kwds.ptr());
+    py::object iter(py::handle<>(::PyObject_GetIter(iterable.ptr())));
+    py::list results;
 
-    std::vector< v8::Handle<v8::Value> > params(args_count + kwds_count);
+    std::vector<v8::Local<v8::Value> > argv;
+    std::vector<size_t> ends;
+    std::vector<v8::Local<v8::Value> > values;
 
-    for (size_t i=0; i<args_count; i++)
-    {
-        params[i] = CPythonObject::Wrap(args[i]);
-    }
+    ends.reserve(chunk_size);
+    values.reserve(chunk_size);
 
-    py::list values = kwds.values();
+    size_t index = 0;
+    bool exhausted = false;
 
-    for (size_t i=0; i<kwds_count; i++)
+    while (!exhausted)
     {
-        params[args_count+i] = CPythonObject::Wrap(values[i]);
-    }
+        v8::HandleScope chunk_scope(isolate);
+        v8::TryCatch try_catch(isolate);
 
-    v8::MaybeLocal<v8::Value> result;
+        argv.clear();
+        ends.clear();
+        values.clear();
 
-    Py_BEGIN_ALLOW_THREADS
+        // the arguments of the whole chunk are converted while holding the GIL
+        while (ends.size() < chunk_size)
+        {
+            PyObject *item = ::PyIter_Next(iter.ptr());
 
-    result = func->Call(context,
-                        self.IsEmpty() ? isolate->GetCurrentContext()->Global() : self,
-                        params.size(), params.empty() ? NULL : &params[0]);
+            if (!item)
+            {
+                if (::PyErr_Occurred()) py::throw_error_already_set();
 
-    Py_END_ALLOW_THREADS
+                exhausted = true;
+                break;
+            }
 
-    if (result.IsEmpty()) CJavascriptException::ThrowIf(isolate, try_catch);
+            py::object args = py::object(py::handle<>(item));
 
-    return CJavascriptObject::Wrap(result.ToLocalChecked());
-}
+            if (PyTuple_Check(item))
+            {
+                for (Py_ssize_t i=0; i<PyTuple_GET_SIZE(item); i++)
+                {
+                    argv.push_back(CPythonObject::Wrap(py::object(py::handle<>(py::borrowed(PyTuple_GET_ITEM(item, i))))));
+                }
+            }
+            else
+            {
+                argv.push_back(CPythonObject::Wrap(args));
+            }
 
-py::object CJavascriptFunction::CreateWithArgs(CJavascriptFunctionPtr proto, py::tuple args, py::dict kwds)
-{
-    v8::Isolate* isolate = v8::Isolate::GetCurrent();
-    v8::HandleScope handle_scope(isolate);
+            ends.push_back(argv.size());
+        }
 
-    CHECK_V8_CONTEXT();
+        bool failed = false;
 
-    if (proto->Object().IsEmpty())
-        throw CJavascriptException("Object prototype may only be an Object", ::PyExc_TypeError);
+        Py_BEGIN_ALLOW_THREADS
 
-    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+        for (size_t i=0, begin=0; i<ends.size(); begin=ends[i++])
+        {
+            v8::Local<v8::Value> result;
 
-    v8::TryCatch try_catch(isolate);
+            if (!func->Call(context, self, ends[i] - begin, argv.data() + begin).ToLocal(&result))
+            {
+                failed = true;
+                break;
+            }
 
-    v8::Handle<v8::Function> func = v8::Handle<v8::Function>::Cast(proto->Object());
+            values.push_back(result);
+        }
 
-    size_t args_count = ::PyTuple_Size(args.ptr());
+        Py_END_ALLOW_THREADS
 
-    std::vector< v8::Handle<v8::Value> > params(args_count);
+        for (size_t i=0; i<values.size(); i++)
+        {
+            results.append(CJavascriptObject::Wrap(values[i]));
+        }
 
-    for (size_t i=0; i<args_count; i++)
-    {
-        params[i] = CPythonObject::Wrap(args[i]);
+        if (failed)
+        {
+            try
+            {
+                CJavascriptException::ThrowIf(isolate, try_catch);
+
+                throw CJavascriptException("execution is terminating", ::PyExc_RuntimeError);
+            }
+            catch (...)
+            {
+                py::handle_exception();
+
+                PyObject *type, *value, *traceback;
+
+                ::PyErr_Fetch(&type, &value, &traceback);
+                ::PyErr_NormalizeException(&type, &value, &traceback);
+
+                // the raised exception reports which item failed, and what was computed before it
+                if (value)
+                {
+                    py::object failed_index(index + values.size());
+
+                    ::PyObject_SetAttrString(value, "index", failed_index.ptr());
+                    ::PyObject_SetAttrString(value, "results", results.ptr());
+                    ::PyErr_Clear();
+                }
+
+                ::PyErr_Restore(type, value, traceback);
+
+                py::throw_error_already_set();
+            }
+        }
+
+        index += values.size();
     }
 
-    v8::Handle<v8::Object> result;
+    return results;
+}
 
-    Py_BEGIN_ALLOW_THREADS
+CJavascriptPreparedCall::CJavascriptPreparedCall(v8::Handle<v8::Function> func, v8::Handle<v8::Value> receiver)
+    : m_isolate(v8::Isolate::GetCurrent()), m_isolate_ref(m_isolate), m_func(m_isolate, func), m_receiver(m_isolate, receiver),
+      m_context(m_isolate, m_isolate->GetCurrentContext())
+{
+}
 
-    result = func->NewInstance(context, params.size(), params.empty() ? NULL : &params[0]).ToLocalChecked();
+py::object CJavascriptPreparedCall::Call(PyObject *const *args, size_t nargs, PyObject *kwds)
+{
+    // the isolate is pinned, so a call from a thread which didn't enter it, or once it was
+    // left or disposed, would run V8 without its isolate
+    if (m_isolate != v8::Isolate::GetCurrent())
+        throw CJavascriptException("prepared call out of its isolate", ::PyExc_RuntimeError);
 
-    Py_END_ALLOW_THREADS
+    CIsolateData::CheckHeapLimitHook(m_isolate);
 
-    if (result.IsEmpty()) CJavascriptException::ThrowIf(isolate, try_catch);
+    v8::HandleScope handle_scope(m_isolate);
 
-    size_t kwds_count = ::PyMapping_Size(kwds.ptr());
-    py::list items = kwds.items();
+    v8::Local<v8::Context> context = m_context.Get(m_isolate);
+    v8::Context::Scope context_scope(context);
 
-    for (size_t i=0; i<kwds_count; i++)
-    {
-        py::tuple item(items[i]);
+    v8::TryCatch try_catch(m_isolate);
 
-        py::str key(item[0]);
-        py::object value = item[1];
+    CJavascriptArgs argv(args, nargs, kwds);
 
-        result->Set(context, ToString(key), CPythonObject::Wrap(value));
-    }
+    v8::MaybeLocal<v8::Value> result = m_func.Get(m_isolate)->Call(context, m_receiver.Get(m_isolate),
+                                                                  argv.Count(), argv.Values());
 
-    return CJavascriptObject::Wrap(result);
+    if (result.IsEmpty()) CJavascriptException::ThrowIf(m_isolate, try_catch);
+
+    return CJavascriptObject::Wrap(result.ToLocalChecked());
 }
 
-py::object CJavascriptFunction::ApplyJavascript(CJavascriptObjectPtr self, py::list args, py::dict kwds)
+py::object CJavascriptPreparedCall::CallWithArgs(py::tuple args, py::dict kwds)
 {
-    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
-    CHECK_V8_CONTEXT();
+    size_t argc = ::PyTuple_Size(args.ptr());
 
-    return Call(self->Object(), args, kwds);
+    if (argc == 0) throw CJavascriptException("missed self argument", ::PyExc_TypeError);
+
+    py::extract<CJavascriptPreparedCall&> extractor(args[0]);
+
+    if (!extractor.check()) throw CJavascriptException("missed self argument", ::PyExc_TypeError);
+
+    return extractor().Call(&PyTuple_GET_ITEM(args.ptr(), 1), argc - 1, kwds.ptr());
 }
 
-py::object CJavascriptFunction::ApplyPython(py::object self, py::list args, py::dict kwds)
+PyObject *CJavascriptPreparedCall::CallPrepared(PyObject *callable, PyObject *args, PyObject *kwds)
 {
-    v8::Isolate* isolate = v8::Isolate::GetCurrent();
-    v8::HandleScope handle_scope(isolate);
+    try
+    {
+        void *call = py::converter::get_lvalue_from_python(callable, py::converter::registered<CJavascriptPreparedCall>::converters);
 
-    CHECK_V8_CONTEXT();
+        if (!call) throw CJavascriptException("missed self argument", ::PyExc_TypeError);
 
-    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+        py::object result = static_cast<CJavascriptPreparedCall *>(call)->Call(&PyTuple_GET_ITEM(args, 0), PyTuple_GET_SIZE(args), kwds);
 
-    return Call(CPythonObject::Wrap(self)->ToObject(context).ToLocalChecked(), args, kwds);
+        return py::incref(result.ptr());
+    }
+    catch (...)
+    {
+        py::handle_exception();
+
+        return NULL;
+    }
 }
 
-py::object CJavascriptFunction::Invoke(py::list args, py::dict kwds)
+void CJavascriptPreparedCall::Expose(void)
 {
-    v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
-    CHECK_V8_CONTEXT();
+    py::object clazz = py::class_<CJavascriptPreparedCall, boost::noncopyable>("JSPreparedCall",
+            "JSPreparedCall is a Javascript function pinned with its receiver and context by JSFunction.prepare.", py::no_init)
+    .def("__call__", py::raw_function(&CJavascriptPreparedCall::CallWithArgs))
+    ;
 
-    return Call(Self(), args, kwds);
+    reinterpret_cast<PyTypeObject *>(clazz.ptr())->tp_call = CallPrepared;
+
+    py::objects::class_value_wrapper<std::shared_ptr<CJavascriptPreparedCall>,
+    py::objects::make_ptr_instance<CJavascriptPreparedCall,
+    py::objects::pointer_holder<std::shared_ptr<CJavascriptPreparedCall>, CJavascriptPreparedCall> > >();
 }
 
 const std::string CJavascriptFunction::GetName(void) const
@@ -1930,6 +2939,241 @@ py::object CJavascriptFunction::GetOwner(void) const
     return CJavascriptObject::Wrap(Self());
 }
 
+PyBufferProcs CJavascriptBuffer::s_buffer_procs = {
+    CJavascriptBuffer::GetBuffer,
+    CJavascriptBuffer::ReleaseBuffer
+};
+
+void CJavascriptBuffer::Expose(void)
+{
+    py::object clazz = py::class_<CJavascriptBuffer, py::bases<CJavascriptObject>, boost::noncopyable>("JSBuffer", py::no_init)
+    .def(py::init<py::object>("Wraps a Python buffer, passed to Javascript as an Uint8Array without copy."))
+
+    .def("__len__", &CJavascriptBuffer::Length)
+
+    .add_property("byteLength", &CJavascriptBuffer::GetByteLength, "The length of the buffer in bytes")
+    .add_property("itemsize", &CJavascriptBuffer::GetItemSize, "The size of an element in bytes")
+    .add_property("format", &CJavascriptBuffer::GetFormat, "The struct module format of an element")
+    ;
+
+    reinterpret_cast<PyTypeObject *>(clazz.ptr())->tp_as_buffer = &s_buffer_procs;
+}
+
+std::mutex CJavascriptBuffer::s_released_lock;
+std::vector<Py_buffer *> CJavascriptBuffer::s_released;
+bool CJavascriptBuffer::s_release_scheduled = false;
+
+CJavascriptBuffer::CJavascriptBuffer(v8::Handle<v8::Object> obj)
+    : CJavascriptObject(obj), m_offset(0), m_length(0), m_itemsize(1), m_format("B")
+{
+    Attach(obj);
+}
+
+CJavascriptBuffer::CJavascriptBuffer(py::object items)
+    : m_items(items), m_offset(0), m_length(0), m_itemsize(1), m_format("B")
+{
+    if (!::PyObject_CheckBuffer(items.ptr()))
+        throw CJavascriptException("argument must support the buffer protocol", ::PyExc_TypeError);
+}
+
+void CJavascriptBuffer::LazyConstructor(void)
+{
+    if (!m_obj.IsEmpty()) return;
+
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+
+    CHECK_V8_CONTEXT();
+
+    v8::Handle<v8::Object> obj = v8::Handle<v8::Object>::Cast(WrapPython(m_items));
+
+    m_obj.Reset(isolate, obj);
+
+    Attach(obj);
+}
+
+void CJavascriptBuffer::DeletePythonBuffer(void *data, size_t length, void *deleter_data)
+{
+    // V8 may free the backing store from a background thread, which must not wait for
+    // the GIL, so the buffer is released later by the main thread
+    bool schedule = false;
+
+    {
+        std::lock_guard<std::mutex> lock(s_released_lock);
+
+        s_released.push_back(static_cast<Py_buffer *>(deleter_data));
+
+        schedule = !s_release_scheduled;
+        s_release_scheduled = true;
+    }
+
+    if (schedule && ::Py_AddPendingCall(ReleasePythonBuffers, NULL) < 0)
+    {
+        // the pending calls queue is full, the next wrapped buffer will drain the list
+        std::lock_guard<std::mutex> lock(s_released_lock);
+
+        s_release_scheduled = false;
+    }
+}
+
+int CJavascriptBuffer::ReleasePythonBuffers(void *arg)
+{
+    std::vector<Py_buffer *> released;
+
+    {
+        std::lock_guard<std::mutex> lock(s_released_lock);
+
+        released.swap(s_released);
+        s_release_scheduled = false;
+    }
+
+    for (size_t i=0; i<released.size(); i++)
+    {
+        ::PyBuffer_Release(released[i]);
+
+        delete released[i];
+    }
+
+    return 0;
+}
+
+v8::Handle<v8::Value> CJavascriptBuffer::WrapPython(py::object obj)
+{
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::EscapableHandleScope handle_scope(isolate);
+
+    CPythonGIL python_gil;
+
+    ReleasePythonBuffers(NULL);
+
+    std::unique_ptr<Py_buffer> view(new Py_buffer);
+
+    bool writable = 0 == ::PyObject_GetBuffer(obj.ptr(), view.get(), PyBUF_WRITABLE);
+
+    if (!writable)
+    {
+        ::PyErr_Clear();
+
+        if (0 != ::PyObject_GetBuffer(obj.ptr(), view.get(), PyBUF_SIMPLE)) throw py::error_already_set();
+    }
+
+    size_t length = view->len;
+    v8::Local<v8::ArrayBuffer> buffer;
+
+    if (writable && length > 0)
+    {
+        void *data = view->buf;
+
+        std::unique_ptr<v8::BackingStore> backing_store = v8::ArrayBuffer::NewBackingStore(
+                    data, length, DeletePythonBuffer, view.release());
+
+        buffer = v8::ArrayBuffer::New(isolate, std::move(backing_store));
+    }
+    else
+    {
+        // Javascript can't be prevented from writing into an ArrayBuffer, so the
+        // immutable Python buffers are copied
+        buffer = v8::ArrayBuffer::New(isolate, length);
+
+        if (length > 0) memcpy(buffer->GetBackingStore()->Data(), view->buf, length);
+
+        ::PyBuffer_Release(view.get());
+    }
+
+    return handle_scope.Escape(v8::Uint8Array::New(buffer, 0, length));
+}
+
+void CJavascriptBuffer::Attach(v8::Handle<v8::Object> obj)
+{
+    if (obj->IsArrayBuffer())
+    {
+        v8::Handle<v8::ArrayBuffer> buffer = obj.As<v8::ArrayBuffer>();
+
+        m_backing_store = buffer->GetBackingStore();
+        m_length = buffer->ByteLength();
+    }
+    else if (obj->IsSharedArrayBuffer())
+    {
+        v8::Handle<v8::SharedArrayBuffer> buffer = obj.As<v8::SharedArrayBuffer>();
+
+        m_backing_store = buffer->GetBackingStore();
+        m_length = buffer->ByteLength();
+    }
+    else
+    {
+        v8::Handle<v8::ArrayBufferView> view = obj.As<v8::ArrayBufferView>();
+
+        // moves the content of a small on-heap typed array to a backing store
+        m_backing_store = view->Buffer()->GetBackingStore();
+        m_offset = view->ByteOffset();
+        m_length = view->ByteLength();
+
+        // Uint8Array, Uint8ClampedArray and DataView are exported as unsigned bytes
+        if (view->IsInt8Array()) { m_itemsize = 1; m_format = "b"; }
+        else if (view->IsInt16Array()) { m_itemsize = 2; m_format = "h"; }
+        else if (view->IsUint16Array()) { m_itemsize = 2; m_format = "H"; }
+        else if (view->IsInt32Array()) { m_itemsize = 4; m_format = "i"; }
+        else if (view->IsUint32Array()) { m_itemsize = 4; m_format = "I"; }
+        else if (view->IsFloat32Array()) { m_itemsize = 4; m_format = "f"; }
+        else if (view->IsFloat64Array()) { m_itemsize = 8; m_format = "d"; }
+        else if (view->IsBigInt64Array()) { m_itemsize = 8; m_format = "q"; }
+        else if (view->IsBigUint64Array()) { m_itemsize = 8; m_format = "Q"; }
+    }
+}
+
+int CJavascriptBuffer::GetBuffer(PyObject *exporter, Py_buffer *view, int flags)
+{
+    py::extract<CJavascriptBuffer&> extractor(exporter);
+
+    if (!extractor.check())
+    {
+        ::PyErr_SetString(::PyExc_BufferError, "not a Javascript buffer");
+
+        view->obj = NULL;
+
+        return -1;
+    }
+
+    CJavascriptBuffer& buffer = extractor();
+
+    // a wrapped Python buffer not yet passed to Javascript exports its own memory
+    if (buffer.m_obj.IsEmpty() && !buffer.m_items.is_none())
+    {
+        return ::PyObject_GetBuffer(buffer.m_items.ptr(), view, flags);
+    }
+
+    // without a format request the consumer expects unsigned bytes
+    bool typed = (flags & PyBUF_FORMAT) == PyBUF_FORMAT;
+    Py_ssize_t itemsize = typed ? buffer.m_itemsize : 1;
+
+    // shape and strides must stay valid until the buffer is released
+    Py_ssize_t *layout = new Py_ssize_t[2];
+
+    layout[0] = buffer.m_length / itemsize;
+    layout[1] = itemsize;
+
+    view->obj = exporter;
+    view->buf = buffer.Data();
+    view->len = buffer.m_length;
+    view->readonly = 0;
+    view->itemsize = itemsize;
+    view->format = typed ? const_cast<char *>(buffer.m_format) : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) == PyBUF_ND ? &layout[0] : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &layout[1] : NULL;
+    view->suboffsets = NULL;
+    view->internal = layout;
+
+    Py_INCREF(exporter);
+
+    return 0;
+}
+
+void CJavascriptBuffer::ReleaseBuffer(PyObject *exporter, Py_buffer *view)
+{
+    delete[] static_cast<Py_ssize_t *>(view->internal);
+}
+
 #ifdef SUPPORT_TRACE_LIFECYCLE
 
 ObjectTracer::ObjectTracer(v8::Handle<v8::Value> handle, py::object *object)
@@ -2028,12 +3272,17 @@ v8::Handle<v8::Value> ObjectTracer::FindCache(py::object obj)
 }
 
 ContextTracer::ContextTracer(v8::Handle<v8::Context> ctxt, LivingMap *living)
-    : m_ctxt(v8::Isolate::GetCurrent(), ctxt), m_living(living)
+    : m_isolate(ctxt->GetIsolate()), m_ctxt(m_isolate, ctxt), m_living(living)
 {
+    CIsolateData::Get(m_isolate)->GetContextTracers().insert(this);
 }
 
 ContextTracer::~ContextTracer(void)
 {
+    CIsolateData *data = CIsolateData::Find(m_isolate);
+
+    if (data) data->GetContextTracers().erase(this);
+
     v8::HandleScope handle_scope(v8::Isolate::GetCurrent());
 
     v8::Handle<v8::Context> ctxt = v8::Isolate::GetCurrent()->GetCurrentContext();
@@ -2067,4 +3316,52 @@ void ContextTracer::Trace(void)
     m_ctxt.SetWeak(this, WeakCallback, v8::WeakCallbackType::kParameter);
 }
 
+namespace {
+
+// The native side of a wrapper, merged into it so the snapshot shows the Python type
+class CPythonNode : public v8::EmbedderGraph::Node
+{
+    v8::EmbedderGraph::Node *m_wrapper;
+    std::string m_name;
+    size_t m_size;
+public:
+    CPythonNode(v8::EmbedderGraph::Node *wrapper, PyTypeObject *type)
+        : m_wrapper(wrapper), m_name(std::string("Python ") + type->tp_name), m_size(type->tp_basicsize)
+    {
+    }
+
+    virtual const char *Name() override {
+        return m_name.c_str();
+    }
+    virtual size_t SizeInBytes() override {
+        return m_size;
+    }
+    virtual Node *WrapperNode() override {
+        return m_wrapper;
+    }
+};
+
+}
+
+void ContextTracer::BuildEmbedderGraph(v8::Isolate *isolate, v8::EmbedderGraph *graph, void *data)
+{
+    v8::HandleScope handle_scope(isolate);
+
+    CIsolateData *isolate_data = CIsolateData::Find(isolate);
+
+    if (!isolate_data) return;
+
+    for (ContextTracer *tracer : isolate_data->GetContextTracers())
+    {
+        for (LivingMap::const_iterator it = tracer->Living().begin(); it != tracer->Living().end(); it++)
+        {
+            v8::Local<v8::Value> wrapper = v8::Local<v8::Value>::New(isolate, it->second->Handle());
+
+            if (wrapper.IsEmpty() || !wrapper->IsObject()) continue;
+
+            graph->AddNode(std::unique_ptr<v8::EmbedderGraph::Node>(new CPythonNode(graph->V8Node(wrapper), Py_TYPE(it->first))));
+        }
+    }
+}
+
 #endif // SUPPORT_TRACE_LIFECYCLE
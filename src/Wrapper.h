@@ -5,16 +5,20 @@
 #include <iostream>
 #include <map>
 #include <sstream>
+#include <mutex>
+#include <vector>
 
-#include "Exception.h"
+#include <v8-profiler.h>
 
-#include <boost/iterator/iterator_facade.hpp>
+#include "Exception.h"
 
 class CJavascriptObject;
 class CJavascriptFunction;
+class CJavascriptPreparedCall;
 
 typedef std::shared_ptr<CJavascriptObject> CJavascriptObjectPtr;
 typedef std::shared_ptr<CJavascriptFunction> CJavascriptFunctionPtr;
+typedef std::shared_ptr<CJavascriptPreparedCall> CJavascriptPreparedCallPtr;
 
 class CJavascriptObject;
 
@@ -48,13 +52,42 @@ public:
     static void DisposeCallback(v8::Persistent<v8::Value> object, void* parameter);
 #endif
 
-    static void SetupObjectTemplate(v8::Isolate *isolate, v8::Handle<v8::ObjectTemplate> clazz);
-    static v8::Handle<v8::ObjectTemplate> CreateObjectTemplate(v8::Isolate *isolate);
+    // The capabilities of a Python type, which select the handlers of its wrapper template
+    enum {
+        TYPE_GENERATOR = 1,
+        TYPE_SEQUENCE = 2,
+        TYPE_MAPPING = 4
+    };
+
+    static int GetTypeFlags(PyTypeObject *type);
+
+    static void SetupObjectTemplate(v8::Isolate *isolate, v8::Handle<v8::ObjectTemplate> clazz, int flags);
+    static v8::Handle<v8::ObjectTemplate> CreateObjectTemplate(v8::Isolate *isolate, int flags);
+    static v8::MaybeLocal<v8::Function> CreateFunction(v8::Isolate *isolate, py::object callable, v8::Handle<v8::Symbol> tag);
+
+    // The native callbacks referenced by the wrapper templates, null terminated
+    static const intptr_t *GetExternalReferences(void);
+
+    enum { SNAPSHOT_NONE = 0, SNAPSHOT_GLOBAL = 1 };
+
+    // The state of the deserialization of a context, its wrappers are traced once the context exists
+    struct CDeserializedFields
+    {
+        py::object *global;
+        std::vector<std::pair<v8::Global<v8::Object>, py::object *> > wrappers;
+    };
+
+    static v8::StartupData SerializeInternalField(v8::Local<v8::Object> holder, int index, void *data);
+    static void DeserializeInternalField(v8::Local<v8::Object> holder, int index, v8::StartupData payload, void *data);
 
     static v8::Handle<v8::Value> WrapInternal(py::object obj);
+    static v8::Handle<v8::Value> WrapCallable(py::object obj);
 
     static bool IsWrapped(v8::Handle<v8::Object> obj);
     static v8::Handle<v8::Value> Wrap(py::object obj);
+
+    // Copies the dicts, lists and tuples into native objects and arrays, and wraps the other objects
+    static v8::Handle<v8::Value> Copy(py::object obj);
     static py::object Unwrap(v8::Handle<v8::Object> obj);
     static void Dispose(v8::Handle<v8::Value> value);
 
@@ -69,6 +102,7 @@ struct ILazyObject
 class CJavascriptObject : public CWrapper
 {
 protected:
+    CIsolateRef m_isolate_ref;
     v8::Persistent<v8::Object> m_obj;
 
     void CheckAttr(v8::Handle<v8::String> name) const;
@@ -99,6 +133,10 @@ public:
     int GetIdentityHash(void);
     CJavascriptObjectPtr Clone(void);
 
+    // Converts the object graph to plain dicts, lists and scalars, down to depth levels of
+    // objects when depth isn't None
+    py::object ConvertToPython(py::object depth);
+
     bool Contains(const std::string& name);
 
     operator long() const;
@@ -145,31 +183,12 @@ class CJavascriptArray : public CJavascriptObject, public ILazyObject
 {
     py::object m_items;
     size_t m_size;
-public:
-    class ArrayIterator
-        : public boost::iterator_facade<ArrayIterator, py::object const, boost::forward_traversal_tag, py::object>
-    {
-        CJavascriptArray *m_array;
-        size_t m_idx;
-    public:
-        ArrayIterator(CJavascriptArray *array, size_t idx)
-            : m_array(array), m_idx(idx)
-        {
-        }
-
-        void increment() {
-            m_idx++;
-        }
-
-        bool equal(ArrayIterator const& other) const {
-            return m_array == other.m_array && m_idx == other.m_idx;
-        }
-
-        reference dereference() const {
-            return m_array->GetItem(py::long_(m_idx));
-        }
-    };
 
+    // Reads count elements from start by step, the step can be negative
+    py::list ReadItems(Py_ssize_t start, Py_ssize_t step, Py_ssize_t count);
+
+    friend class CJavascriptArrayIterator;
+public:
     CJavascriptArray(v8::Handle<v8::Array> array)
         : CJavascriptObject(array), m_size(array->Length())
     {
@@ -187,22 +206,43 @@ public:
     py::object DelItem(py::object key);
     bool Contains(py::object item);
 
-    ArrayIterator begin(void) {
-        return ArrayIterator(this, 0);
-    }
-    ArrayIterator end(void) {
-        return ArrayIterator(this, Length());
-    }
+    // Converts the elements of the array in a single pass over its backing store
+    py::list ToList(void);
+    static py::object Iter(py::object self);
 
     // ILazyObject
     virtual void LazyConstructor(void);
 };
 
+// Iterates over an array by windows of elements, each one read in a single pass. A pass always
+// starts from the first element, so the windows double up to MAX_WINDOW_SIZE, which keeps the
+// whole iteration linear while a loop breaking early only converts a few elements.
+class CJavascriptArrayIterator
+{
+    py::object m_array;
+    size_t m_pos;
+
+    py::list m_window;
+    size_t m_window_size;
+    size_t m_index;
+public:
+    static constexpr size_t MIN_WINDOW_SIZE = 1024;
+    static constexpr size_t MAX_WINDOW_SIZE = 1024 * 1024;
+
+    CJavascriptArrayIterator(py::object array)
+        : m_array(array), m_pos(0), m_window_size(MIN_WINDOW_SIZE), m_index(0)
+    {
+    }
+
+    py::object Next(void);
+};
+
 class CJavascriptFunction : public CJavascriptObject
 {
     v8::Persistent<v8::Object> m_self;
 
     py::object Call(v8::Handle<v8::Object> self, py::list args, py::dict kwds);
+    py::object Call(v8::Handle<v8::Object> self, PyObject *const *args, size_t nargs, PyObject *kwds);
 public:
     CJavascriptFunction(v8::Handle<v8::Object> self, v8::Handle<v8::Function> func)
         : CJavascriptObject(func), m_self(v8::Isolate::GetCurrent(), self)
@@ -219,12 +259,21 @@ public:
     }
 
     static py::object CallWithArgs(py::tuple args, py::dict kwds);
+    static PyObject *CallFunction(PyObject *callable, PyObject *args, PyObject *kwds);
     static py::object CreateWithArgs(CJavascriptFunctionPtr proto, py::tuple args, py::dict kwds);
 
     py::object ApplyJavascript(CJavascriptObjectPtr self, py::list args, py::dict kwds);
     py::object ApplyPython(py::object self, py::list args, py::dict kwds);
     py::object Invoke(py::list args, py::dict kwds);
 
+    CJavascriptPreparedCallPtr Prepare(py::object receiver);
+
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 1024;
+
+    // Calls the function once per item, a tuple of arguments or a single argument,
+    // converting and calling chunk_size items at a time with the GIL released
+    py::list Map(py::object iterable, size_t chunk_size);
+
     const std::string GetName(void) const;
     void SetName(const std::string& name);
 
@@ -238,6 +287,96 @@ public:
     py::object GetOwner(void) const;
 };
 
+// A function pinned with its receiver and context, for the functions called at a high rate:
+// a call only converts the arguments and runs the function, and keeps the GIL
+class CJavascriptPreparedCall
+{
+    v8::Isolate *m_isolate;
+    CIsolateRef m_isolate_ref;
+
+    v8::Global<v8::Function> m_func;
+    v8::Global<v8::Value> m_receiver;
+    v8::Global<v8::Context> m_context;
+public:
+    CJavascriptPreparedCall(v8::Handle<v8::Function> func, v8::Handle<v8::Value> receiver);
+
+    py::object Call(PyObject *const *args, size_t nargs, PyObject *kwds);
+
+    static py::object CallWithArgs(py::tuple args, py::dict kwds);
+    static PyObject *CallPrepared(PyObject *callable, PyObject *args, PyObject *kwds);
+
+    static void Expose(void);
+};
+
+// ArrayBuffer, SharedArrayBuffer, typed arrays and DataView, exported through the Python
+// buffer protocol directly over the V8 backing store, which is kept alive by the wrapper
+class CJavascriptBuffer : public CJavascriptObject, public ILazyObject
+{
+    py::object m_items;
+
+    std::shared_ptr<v8::BackingStore> m_backing_store;
+
+    size_t m_offset;
+    size_t m_length;
+    size_t m_itemsize;
+    const char *m_format;
+
+    static PyBufferProcs s_buffer_procs;
+
+    static int GetBuffer(PyObject *exporter, Py_buffer *view, int flags);
+    static void ReleaseBuffer(PyObject *exporter, Py_buffer *view);
+
+    // Python buffers released by the V8 backing store deleters, waiting for the GIL
+    static std::mutex s_released_lock;
+    static std::vector<Py_buffer *> s_released;
+    static bool s_release_scheduled;
+
+    static void DeletePythonBuffer(void *data, size_t length, void *deleter_data);
+    static int ReleasePythonBuffers(void *arg);
+
+    void Attach(v8::Handle<v8::Object> obj);
+public:
+    CJavascriptBuffer(v8::Handle<v8::Object> obj);
+    CJavascriptBuffer(py::object items);
+
+    // Returns an Uint8Array over the memory of a Python buffer, copied when it is read-only
+    static v8::Handle<v8::Value> WrapPython(py::object obj);
+
+    static bool IsBuffer(v8::Handle<v8::Object> obj) {
+        return obj->IsArrayBuffer() || obj->IsSharedArrayBuffer() || obj->IsArrayBufferView();
+    }
+
+    char *Data(void) const {
+        return m_backing_store ? static_cast<char *>(m_backing_store->Data()) + m_offset : NULL;
+    }
+
+    size_t GetByteLength(void) {
+        LazyConstructor();
+
+        return m_length;
+    }
+    size_t GetItemSize(void) {
+        LazyConstructor();
+
+        return m_itemsize;
+    }
+    const std::string GetFormat(void) {
+        LazyConstructor();
+
+        return m_format;
+    }
+    size_t Length(void) {
+        LazyConstructor();
+
+        return m_length / m_itemsize;
+    }
+
+    // ILazyObject
+    virtual void LazyConstructor(void);
+
+    static void Expose(void);
+};
+
 #ifdef SUPPORT_TRACE_LIFECYCLE
 
 class ObjectTracer;
@@ -276,6 +415,7 @@ public:
 
 class ContextTracer
 {
+    v8::Isolate *m_isolate; // the tracer is registered in the data of its isolate, whichever is current
     v8::Persistent<v8::Context> m_ctxt;
     std::unique_ptr<LivingMap> m_living;
 
@@ -287,10 +427,17 @@ public:
     ~ContextTracer(void);
 
     v8::Handle<v8::Context> Context(void) const {
-        return v8::Local<v8::Context>::New(v8::Isolate::GetCurrent(), m_ctxt);
+        return v8::Local<v8::Context>::New(m_isolate, m_ctxt);
+    }
+
+    const LivingMap& Living(void) const {
+        return *m_living;
     }
 
     static void Trace(v8::Handle<v8::Context> ctxt, LivingMap *living);
+
+    // Labels the wrappers of the living Python objects with their type in the heap snapshots
+    static void BuildEmbedderGraph(v8::Isolate *isolate, v8::EmbedderGraph *graph, void *data);
 };
 
 #endif
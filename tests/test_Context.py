@@ -123,6 +123,55 @@ class TestContext(unittest.TestCase):
 
             self.assertEqual("Still working on something else", ctxt.locals.message)
 
+    def testToJavascript(self):
+        with STPyV8.JSContext() as ctxt:
+            payload = {
+                "id": 42,
+                "big": 2**40,
+                "ratio": 0.5,
+                "name": "caf\u00e9",
+                "tags": ["a", "b"],
+                "pair": (1, None),
+                "flags": {"on": True, "off": False},
+                "1": "one",
+            }
+
+            ctxt.locals.payload = ctxt.to_js(payload)
+
+            self.assertEqual(
+                '{"1":"one","id":42,"big":1099511627776,"ratio":0.5,"name":"caf\u00e9",'
+                '"tags":["a","b"],"pair":[1,null],"flags":{"on":true,"off":false}}',
+                ctxt.eval("JSON.stringify(payload)"),
+            )
+            self.assertTrue(ctxt.eval("Array.isArray(payload.tags) && Array.isArray(payload.pair)"))
+            self.assertTrue(ctxt.eval("Object.getPrototypeOf(payload) === Object.prototype"))
+
+            # the copy is detached from the Python objects
+            payload["id"] = 0
+            self.assertEqual(42, ctxt.eval("payload.id"))
+
+            self.assertIsInstance(ctxt.to_js([1, 2]), STPyV8.JSArray)
+            self.assertIs(payload, ctxt.to_js(payload, copy=False))
+
+            class Point:
+                x = 1
+
+            ctxt.locals.shape = ctxt.to_js({"origin": Point()})
+            self.assertEqual(1, ctxt.eval("shape.origin.x"))
+
+            cyclic = []
+            cyclic.append(cyclic)
+
+            with self.assertRaises(TypeError):
+                ctxt.to_js(cyclic)
+
+            with self.assertRaises(TypeError):
+                ctxt.to_js({1: "one"})
+
+            shared = [1]
+            ctxt.locals.twice = ctxt.to_js([shared, shared])
+            self.assertEqual("[[1],[1]]", ctxt.eval("JSON.stringify(twice)"))
+
     def testSecurityChecks(self):
         with STPyV8.JSContext() as env1:
             env1.securityToken = "foo"
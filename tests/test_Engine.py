@@ -1,6 +1,8 @@
 #!/usr/bin/env python
 # -*- coding: utf-8 -*-
 
+import os
+import tempfile
 import unittest
 
 import STPyV8
@@ -24,6 +26,97 @@ class TestEngine(unittest.TestCase):
 
                 self.assertRaises(SyntaxError, engine.compile, "1+")
 
+    def testSnapshot(self):
+        class Global:
+            name = "first"
+
+        snapshot = STPyV8.JSEngine.serialize(
+            "var answer = 42; var captured = name; var proto = this.__proto__;", Global()
+        )
+
+        self.assertTrue(isinstance(snapshot, bytes))
+        self.assertRaises(STPyV8.JSError, STPyV8.JSEngine.serialize, "throw Error('boot')")
+        self.assertRaises(ValueError, STPyV8.JSEngine.deserialize, b"not a snapshot")
+
+        STPyV8.JSEngine.deserialize(snapshot)
+
+        try:
+            self.assertTrue(STPyV8.JSEngine.serializeEnabled)
+
+            class Other:
+                name = "second"
+
+            with STPyV8.JSIsolate():
+                with STPyV8.JSContext(Other()) as ctxt:
+                    self.assertEqual(42, ctxt.eval("answer"))
+                    self.assertEqual("first", ctxt.eval("captured"))
+                    self.assertEqual("second", ctxt.eval("proto.name"))
+        finally:
+            STPyV8.JSEngine.serializeEnabled = False
+
+        with STPyV8.JSIsolate():
+            with STPyV8.JSContext() as ctxt:
+                self.assertEqual("undefined", ctxt.eval("typeof answer"))
+
+    def testRunInContexts(self):
+        with STPyV8.JSContext():
+            with STPyV8.JSEngine() as engine:
+                s = engine.compile("var counter = (this.counter || 0) + 1; counter")
+
+        for _ in range(3):
+            with STPyV8.JSContext() as ctxt:
+                self.assertEqual(1, s.run(ctxt))
+                self.assertEqual(2, s.run(ctxt))
+                self.assertEqual(3, s.run())
+
+    def testCodeCache(self):
+        with tempfile.TemporaryDirectory() as directory:
+            STPyV8.JSEngine.enableCodeCache(directory)
+
+            try:
+                src = "function square(x) { return x * x; } square(7);"
+
+                stats = STPyV8.JSEngine.codeCacheStats
+
+                with STPyV8.JSContext() as ctxt:
+                    self.assertEqual(49, ctxt.eval(src))
+
+                self.assertEqual(stats["misses"] + 1, STPyV8.JSEngine.codeCacheStats["misses"])
+                self.assertEqual(stats["stores"] + 1, STPyV8.JSEngine.codeCacheStats["stores"])
+                self.assertEqual(1, len(os.listdir(directory)))
+
+                with STPyV8.JSContext() as ctxt:
+                    self.assertEqual(49, ctxt.eval(src))
+
+                self.assertEqual(stats["hits"] + 1, STPyV8.JSEngine.codeCacheStats["hits"])
+
+                # an entry is only consumed by the source it was compiled from
+                path = os.path.join(directory, os.listdir(directory)[0])
+
+                with open(path, "rb") as f:
+                    entry = f.read()
+
+                with open(path, "wb") as f:
+                    f.write(entry.replace(b"square(7)", b"square(8)", 1))
+
+                stats = STPyV8.JSEngine.codeCacheStats
+
+                with STPyV8.JSIsolate(owner=True):
+                    with STPyV8.JSContext() as ctxt:
+                        self.assertEqual(49, ctxt.eval(src))
+
+                self.assertEqual(stats["hits"], STPyV8.JSEngine.codeCacheStats["hits"])
+                self.assertEqual(stats["misses"] + 1, STPyV8.JSEngine.codeCacheStats["misses"])
+
+                STPyV8.JSEngine.clearCodeCache()
+
+                self.assertEqual(0, STPyV8.JSEngine.codeCacheStats["entries"])
+                self.assertEqual(0, len(os.listdir(directory)))
+            finally:
+                STPyV8.JSEngine.disableCodeCache()
+
+        self.assertFalse(STPyV8.JSEngine.codeCacheStats["enabled"])
+
     def testUnicodeSource(self):
         class Global(STPyV8.JSClass):
             var = "测试"
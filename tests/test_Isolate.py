@@ -1,6 +1,10 @@
 #!/usr/bin/env python
 # -*- coding: utf-8 -*-
 
+import json
+import os
+import tempfile
+import time
 import unittest
 
 import STPyV8
@@ -15,3 +19,311 @@ class TestIsolate(unittest.TestCase):
     def testEnterLeave(self):
         with STPyV8.JSIsolate() as isolate:
             self.assertIsNotNone(isolate.current)
+
+    def testResourceConstraints(self):
+        MB = 1024 * 1024
+
+        with STPyV8.JSIsolate(
+            owner=True, max_old_space=64 * MB, max_young_space=16 * MB, initial_heap=8 * MB
+        ) as isolate:
+            self.assertIsNotNone(isolate.current)
+
+            with STPyV8.JSContext() as ctxt:
+                self.assertEqual(1000, ctxt.eval("new Array(1000).fill(0).length"))
+
+        with self.assertRaises(ValueError):
+            STPyV8.JSIsolate(max_old_space=8 * MB, initial_heap=16 * MB)
+
+    def testHeapLimitPolicy(self):
+        MB = 1024 * 1024
+
+        runaway = "(function () { var a = []; while (true) { a.push(new Array(100000).fill(1.5)); } })()"
+
+        with STPyV8.JSIsolate(owner=True, max_old_space=32 * MB) as isolate:
+            self.assertEqual(STPyV8.JSIsolate.HeapLimitPolicy.Grow, isolate.heapLimitPolicy)
+
+            isolate.setHeapLimitPolicy(STPyV8.JSIsolate.HeapLimitPolicy.Terminate, 4 * MB, 8 * MB)
+
+            with STPyV8.JSContext() as ctxt:
+                with self.assertRaises(STPyV8.JSError) as cm:
+                    ctxt.eval(runaway)
+
+                self.assertIn("heap limit exceeded", str(cm.exception))
+
+                # the isolate keeps serving the next scripts
+                self.assertEqual(2, ctxt.eval("1+1"))
+
+            calls = []
+
+            def hook(current_limit, initial_limit):
+                calls.append((current_limit, initial_limit))
+
+                return current_limit + 4 * MB if len(calls) < 2 else None
+
+            isolate.setHeapLimitPolicy(STPyV8.JSIsolate.HeapLimitPolicy.Hook, hook=hook)
+
+            with STPyV8.JSContext() as ctxt:
+                self.assertRaises(STPyV8.JSError, ctxt.eval, runaway)
+                self.assertEqual(2, ctxt.eval("1+1"))
+
+            self.assertGreaterEqual(len(calls), 2)
+            self.assertEqual(calls[0][0] + 4 * MB, calls[1][0])
+
+            errors = []
+
+            def reentrant_hook(current_limit, initial_limit):
+                try:
+                    ctxt.eval("1+1")
+                except RuntimeError as e:
+                    errors.append(e)
+
+            isolate.setHeapLimitPolicy(STPyV8.JSIsolate.HeapLimitPolicy.Hook, hook=reentrant_hook)
+
+            with STPyV8.JSContext() as ctxt:
+                self.assertRaises(STPyV8.JSError, ctxt.eval, runaway)
+                self.assertEqual(2, ctxt.eval("1+1"))
+
+            self.assertTrue(errors)
+
+            with self.assertRaises(TypeError):
+                isolate.setHeapLimitPolicy(STPyV8.JSIsolate.HeapLimitPolicy.Hook)
+
+    def testHeapStatistics(self):
+        MB = 1024 * 1024
+
+        with STPyV8.JSIsolate(owner=True, max_old_space=128 * MB) as isolate:
+            with STPyV8.JSContext() as ctxt:
+                ctxt.eval("var data = new Array(100000).fill('x');")
+
+                stats = isolate.heap_statistics()
+
+                self.assertGreater(stats["used_heap_size"], 0)
+                self.assertLessEqual(stats["used_heap_size"], stats["total_heap_size"])
+                self.assertGreaterEqual(stats["heap_size_limit"], 128 * MB)
+                self.assertGreaterEqual(stats["number_of_native_contexts"], 1)
+
+                spaces = isolate.heap_space_statistics()
+
+                self.assertIn("old_space", spaces)
+                self.assertGreater(sum(space["space_used_size"] for space in spaces.values()), 0)
+
+                self.assertIn("bytecode_and_metadata_size", isolate.code_statistics())
+
+                results = []
+
+                ctxt.measure_memory(results.append)
+
+                for _ in range(100):
+                    if results:
+                        break
+
+                    if not isolate.pump_message_loop():
+                        time.sleep(0.01)
+
+                self.assertEqual(1, len(results))
+                self.assertGreater(results[0]["size"], 100000)
+
+                self.assertRaises(TypeError, ctxt.measure_memory, None)
+
+    def testHeapSnapshot(self):
+        class HeapSnapshotProbe:
+            pass
+
+        with STPyV8.JSIsolate() as isolate:
+            with STPyV8.JSContext() as ctxt:
+                ctxt.locals.probe = HeapSnapshotProbe()
+
+                with tempfile.TemporaryDirectory() as folder:
+                    path = os.path.join(folder, "test.heapsnapshot")
+
+                    isolate.write_heap_snapshot(path)
+
+                    with open(path, encoding="utf-8") as f:
+                        snapshot = json.load(f)
+
+                self.assertIn("nodes", snapshot)
+                self.assertTrue(any("HeapSnapshotProbe" in name for name in snapshot["strings"]))
+
+                self.assertRaises(OSError, isolate.write_heap_snapshot, os.path.join(folder, "missing", "x"))
+
+    def testCpuProfile(self):
+        with STPyV8.JSIsolate() as isolate:
+            with STPyV8.JSContext() as ctxt:
+                isolate.start_profiling("test", sampling_interval_us=100)
+
+                self.assertRaises(ValueError, isolate.start_profiling, "test")
+
+                ctxt.eval("""
+                    function hotFunction(n) {
+                        var s = 0;
+                        for (var i = 0; i < n; i++) s += Math.sqrt(i);
+                        return s;
+                    }
+                    var end = Date.now() + 200;
+                    while (Date.now() < end) hotFunction(10000);
+                """)
+
+                profile = isolate.stop_profiling("test")
+
+                self.assertRaises(ValueError, isolate.stop_profiling, "test")
+
+            self.assertEqual("test", profile.title)
+            self.assertGreater(profile.samplesCount, 0)
+            self.assertLessEqual(profile.startTime, profile.endTime)
+
+            cpuprofile = json.loads(profile.to_cpuprofile())
+
+            self.assertEqual(profile.samplesCount, len(cpuprofile["samples"]))
+            self.assertEqual(len(cpuprofile["samples"]), len(cpuprofile["timeDeltas"]))
+            self.assertTrue(any(node["callFrame"]["functionName"] == "hotFunction" for node in cpuprofile["nodes"]))
+
+            pprof = profile.to_pprof()
+
+            self.assertIsInstance(pprof, bytes)
+            self.assertIn(b"hotFunction", pprof)
+
+            with tempfile.TemporaryDirectory() as folder:
+                path = os.path.join(folder, "test.cpuprofile")
+
+                profile.write_cpuprofile(path)
+
+                with open(path, encoding="utf-8") as f:
+                    self.assertEqual(cpuprofile, json.load(f))
+
+                path = os.path.join(folder, "test.pb")
+
+                profile.write_pprof(path)
+
+                with open(path, "rb") as f:
+                    self.assertEqual(pprof, f.read())
+
+    def testIsolatePool(self):
+        pool = STPyV8.JSIsolatePool(2, max_uses=2)
+
+        self.assertEqual(2, pool.size)
+
+        for _ in range(3):
+            with pool.checkout() as pooled:
+                self.assertTrue(pooled.checkedOut)
+                self.assertTrue(pooled.isolate.locked)
+
+                with STPyV8.JSContext() as ctxt:
+                    self.assertEqual(3, ctxt.eval("1+2"))
+
+                # the isolate can't be recycled or handed out with its context alive
+                del ctxt
+
+            self.assertFalse(pooled.checkedOut)
+
+        stats = pool.stats
+
+        self.assertEqual(3, stats["checkouts"])
+        self.assertEqual(1, stats["recycled"])
+        self.assertEqual(2, stats["idle"])
+
+        first = pool.checkout()
+        second = pool.checkout()
+
+        self.assertRaises(TimeoutError, pool.checkout, 0.01)
+        self.assertEqual(1, pool.stats["timeouts"])
+
+        second.release()
+
+        ctxt = STPyV8.JSContext()
+
+        self.assertRaises(RuntimeError, first.release)
+        self.assertTrue(first.checkedOut)
+
+        del ctxt
+
+        first.release()
+
+        self.assertEqual(0, pool.stats["in_use"])
+
+    def testIsolatePoolTenants(self):
+        pool = STPyV8.JSIsolatePool(1)
+
+        with pool.checkout() as pooled:
+            pooled.isolate.setHeapLimitPolicy(STPyV8.JSIsolate.HeapLimitPolicy.Terminate)
+            pooled.isolate.start_profiling("tenant")
+
+            with STPyV8.JSContext() as ctxt:
+                ctxt.eval("1+2")
+
+            del ctxt
+
+        with pool.checkout() as pooled:
+            isolate = pooled.isolate
+
+            self.assertEqual(STPyV8.JSIsolate.HeapLimitPolicy.Grow, isolate.heapLimitPolicy)
+            self.assertEqual(0, isolate.scriptCacheStats["entries"])
+            self.assertRaises(ValueError, isolate.stop_profiling, "tenant")
+
+    def testScriptCache(self):
+        with STPyV8.JSIsolate() as isolate:
+            with STPyV8.JSContext() as ctxt:
+                for _ in range(3):
+                    self.assertEqual(3, ctxt.eval("1+2"))
+
+                stats = isolate.scriptCacheStats
+
+                self.assertEqual(1, stats["entries"])
+                self.assertEqual(1, stats["misses"])
+                self.assertEqual(2, stats["hits"])
+                self.assertTrue(stats["source_bytes"] > 0)
+
+            with STPyV8.JSContext() as ctxt:
+                self.assertEqual(3, ctxt.eval("1+2"))
+                self.assertEqual(3, isolate.scriptCacheStats["hits"])
+
+                self.assertEqual(3, ctxt.eval("1+2", "other.js"))
+                self.assertEqual(2, isolate.scriptCacheStats["entries"])
+
+                isolate.clearScriptCache()
+                self.assertEqual(0, isolate.scriptCacheStats["entries"])
+
+                isolate.setScriptCacheSize(0)
+                self.assertEqual(3, ctxt.eval("1+2"))
+                self.assertEqual(0, isolate.scriptCacheStats["entries"])
+
+    def testFunctionCache(self):
+        class Counter:
+            def __init__(self):
+                self.count = 0
+
+            def incr(self, step):
+                self.count += step
+                return self.count
+
+        def add(a, b):
+            return a + b
+
+        with STPyV8.JSIsolate() as isolate:
+            with STPyV8.JSContext() as ctxt:
+                same = ctxt.eval("(function (a, b) { return a === b; })")
+                call = ctxt.eval("(function (f, x) { return f(x, 1); })")
+
+                self.assertTrue(same(add, add))
+                self.assertEqual(3, call(add, 2))
+
+                first, second = Counter(), Counter()
+
+                # the bound methods don't depend on a script visible bind
+                ctxt.eval("Function.prototype.bind = function () { throw new Error('hijacked'); }")
+
+                self.assertEqual(2, call(first.incr, 2))
+                self.assertEqual(5, call(first.incr, 3))
+                self.assertEqual(4, call(second.incr, 4))
+                self.assertEqual(5, first.count)
+
+                # every bound method of the same function and receiver maps to one function
+                self.assertTrue(same(first.incr, first.incr))
+                self.assertFalse(same(first.incr, second.incr))
+
+                stats = isolate.functionCacheStats
+
+                self.assertEqual(3, stats["entries"])
+                self.assertTrue(stats["hits"] >= 3)
+
+            with STPyV8.JSContext() as ctxt:
+                self.assertEqual(7, ctxt.eval("(function (f) { return f(3, 4); })")(add))
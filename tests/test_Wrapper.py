@@ -4,6 +4,7 @@
 import sys
 import os
 import datetime
+import threading
 import unittest
 import pytest
 
@@ -215,6 +216,26 @@ class TestWrapper(unittest.TestCase):
         with STPyV8.JSContext(Global()) as ctxt:
             self.assertEqual("hello world", ctxt.eval("hello('world')"))
 
+    def testCallArity(self):
+        def count(*args):
+            return len(args)
+
+        def total(*args):
+            return sum(args)
+
+        class Global(STPyV8.JSClass):
+            def add(self, *args):
+                return sum(args)
+
+        with STPyV8.JSContext(Global()) as ctxt:
+            call = ctxt.eval("(function (f, n) { return f.apply(null, Array.from({length: n}, (_, i) => i)); })")
+
+            for n in (0, 3, 8, 9, 16, 100):
+                self.assertEqual(n, call(count, n))
+                self.assertEqual(n * (n - 1) // 2, call(total, n))
+
+            self.assertEqual(120, ctxt.eval("add(" + ", ".join(str(i) for i in range(16)) + ")"))
+
     def testJSFunction(self):
         with STPyV8.JSContext() as ctxt:
             hello = ctxt.eval("(function (name) { return 'Hello ' + name; })")
@@ -236,6 +257,73 @@ class TestWrapper(unittest.TestCase):
                 "Hello world from json", hello.apply({"name": "json"}, ["world"])
             )
 
+            count = ctxt.eval("(function () { return arguments.length; })")
+
+            for n in (0, 3, 8, 9, 16):
+                self.assertEqual(n, count(*range(n)))
+                self.assertEqual(n, count.__call__(*range(n)))
+
+            self.assertEqual(3, count(1, a=2, b=3))
+            self.assertEqual("1,2,3", ctxt.eval("(function () { return Array.from(arguments).join(); })")(1, b=2, c=3))
+            self.assertRaises(STPyV8.JSError, ctxt.eval("(function () { throw Error('x'); })"))
+
+    def testPreparedCall(self):
+        with STPyV8.JSContext() as ctxt:
+            obj = ctxt.eval(
+                "({ 'base': 10, 'eval': function (a, b) { if (a < 0) throw Error('negative'); return this.base + a * b; }})"
+            )
+
+            rule = obj.eval.prepare()
+
+            self.assertTrue(isinstance(rule, STPyV8.JSPreparedCall))
+            self.assertEqual(16, rule(2, 3))
+            self.assertEqual(10, rule(0, 3))
+            self.assertEqual(16, rule.__call__(2, 3))
+
+            other = obj.eval.prepare(ctxt.eval("({ 'base': 100 })"))
+            self.assertEqual(106, other(2, 3))
+
+            self.assertRaises(STPyV8.JSError, rule, -1, 0)
+            self.assertEqual(sum(10 + i for i in range(1000)), sum(rule(i, 1) for i in range(1000)))
+
+        # the call keeps working on the pinned context once it was left
+        self.assertEqual(16, rule(2, 3))
+
+        # but not from a thread which didn't enter its isolate
+        errors = []
+
+        def call():
+            try:
+                rule(2, 3)
+            except RuntimeError as e:
+                errors.append(e)
+
+        thread = threading.Thread(target=call)
+        thread.start()
+        thread.join()
+
+        self.assertEqual(1, len(errors))
+
+    def testMap(self):
+        with STPyV8.JSContext() as ctxt:
+            add = ctxt.eval("(function (a, b) { if (a < 0) throw Error('negative'); return a + (b || 0); })")
+
+            self.assertEqual([], add.map([]))
+            self.assertEqual([1, 2, 3], add.map([1, 2, 3]))
+            self.assertEqual([3, 7], add.map([(1, 2), (3, 4)]))
+
+            records = ((i, i) for i in range(2500))
+            self.assertEqual([2 * i for i in range(2500)], add.map(records, chunk_size=100))
+
+            self.assertRaises(ValueError, add.map, [1], chunk_size=0)
+
+            with self.assertRaises(STPyV8.JSError) as cm:
+                add.map([(1, 1), (2, 2), (-1, 0), (3, 3)], chunk_size=2)
+
+            self.assertEqual(2, cm.exception.index)
+            self.assertEqual([2, 4], cm.exception.results)
+            self.assertTrue("negative" in str(cm.exception))
+
     def testConstructor(self):
         with STPyV8.JSContext() as ctx:
             ctx.eval(
@@ -611,6 +699,113 @@ class TestWrapper(unittest.TestCase):
                 )(STPyV8.JSArray(list(range(3)))),
             )
 
+    def testArrayConstruction(self):
+        with STPyV8.JSContext() as ctxt:
+            join = ctxt.eval("(function (arr) { return arr.length + ':' + arr.join(','); })")
+
+            self.assertEqual("3:1,2,3", join(STPyV8.JSArray([1, 2, 3])))
+            self.assertEqual("3:1.5,2.5,-3", join(STPyV8.JSArray((1.5, 2.5, -3.0))))
+            self.assertEqual("4:1,2.5,a,", join(STPyV8.JSArray([1, 2.5, "a", None])))
+            self.assertEqual("0:", join(STPyV8.JSArray([])))
+            self.assertEqual("2:1099511627776,-2147483649", join(STPyV8.JSArray([2**40, -(2**31) - 1])))
+            self.assertEqual("1:18446744073709552000", join(STPyV8.JSArray([2**64])))
+            self.assertEqual("3:0,1,4", join(STPyV8.JSArray(i * i for i in range(3))))
+
+            array = STPyV8.JSArray(i for i in range(10000))
+
+            self.assertEqual(10000, len(array))
+            self.assertEqual(9999, array[9999])
+            self.assertEqual(
+                49995000, ctxt.eval("(function (arr) { return arr.reduce((a, b) => a + b, 0); })")(array)
+            )
+
+            array = STPyV8.JSArray(str(i) for i in range(2500))
+
+            self.assertEqual(2500, len(array))
+            self.assertEqual("2499", array[2499])
+
+            # the generator items don't go through the script visible Array.prototype.push
+            ctxt.eval("Array.prototype.push = function () { throw Error('hijacked'); }")
+
+            self.assertEqual("3:0,1,2", join(STPyV8.JSArray(i for i in range(3))))
+
+    def testArrayToList(self):
+        with STPyV8.JSContext() as ctxt:
+            array = ctxt.eval("[1, 2.5, 'a', null, undefined, true, [3], {b: 4}, , 5]")
+
+            items = array.tolist()
+
+            self.assertEqual(10, len(items))
+            self.assertEqual([1, 2.5, "a", None, None, True], items[:6])
+            self.assertEqual([3], list(items[6]))
+            self.assertEqual(4, items[7].b)
+            self.assertEqual([None, 5], items[8:])
+
+            self.assertEqual(items[:6], list(array)[:6])
+
+            array = ctxt.eval("Array.from({length: 100000}, (_, i) => i)")
+
+            self.assertEqual(list(range(100000)), array.tolist())
+            self.assertEqual(list(range(100000)), list(array))
+
+            self.assertEqual([10, 11, 12], array[10:13])
+            self.assertEqual([10, 15, 20], array[10:25:5])
+            self.assertEqual([99999, 99998], array[:-3:-1])
+            self.assertEqual([20, 15, 10], array[20:5:-5])
+            self.assertEqual([], array[5:5])
+
+            self.assertEqual([], ctxt.eval("[]").tolist())
+
+            # the iteration only reads the windows of elements it reaches
+            sparse = ctxt.eval("var sparse = []; sparse[4294967294] = 1; sparse")
+
+            self.assertEqual([None, None], [item for item, _ in zip(sparse, range(2))])
+
+    def testToPython(self):
+        with STPyV8.JSContext() as ctxt:
+            value = ctxt.eval(
+                """
+                ({a: 1, b: 2.5, c: 'x', d: null, e: undefined, f: true,
+                  g: [1, [2, {h: 3}]], 0: 'zero', i: function () {}, j: new Date(0)})
+                """
+            )
+
+            result = STPyV8.to_python(value)
+
+            self.assertIs(dict, type(result))
+            self.assertEqual(
+                {"0": "zero", "a": 1, "b": 2.5, "c": "x", "d": None, "e": None, "f": True, "g": [1, [2, {"h": 3}]]},
+                {k: v for k, v in result.items() if k not in ("i", "j")},
+            )
+            self.assertIsInstance(result["i"], STPyV8.JSFunction)
+            self.assertIsInstance(result["j"], datetime.datetime)
+
+            self.assertEqual([1, 2, 3], ctxt.eval("[1, 2, 3]").to_python())
+            self.assertEqual(5, STPyV8.to_python(5))
+
+            nested = ctxt.eval("({a: {b: {c: {}}}})")
+
+            result = nested.to_python(depth=2)
+
+            self.assertIs(dict, type(result["a"]))
+            self.assertIsInstance(result["a"]["b"], STPyV8.JSObject)
+            self.assertEqual({}, result["a"]["b"].to_python()["c"])
+            self.assertIsInstance(nested.to_python(depth=0), STPyV8.JSObject)
+
+            with self.assertRaises(ValueError):
+                nested.to_python(depth=-1)
+
+            cyclic = ctxt.eval("var o = {name: 'o', items: []}; o.items.push(o, o); o.self = o; o")
+
+            result = cyclic.to_python()
+
+            self.assertIs(result, result["self"])
+            self.assertIs(result, result["items"][0])
+            self.assertIs(result, result["items"][1])
+
+            with self.assertRaises(STPyV8.JSError):
+                ctxt.eval("({get a() { throw new Error('boom'); }})").to_python()
+
     def testArraySlices(self):
         with STPyV8.JSContext() as ctxt:
             array = ctxt.eval(
@@ -713,6 +908,73 @@ class TestWrapper(unittest.TestCase):
 
             self.assertEqual([[1, "abla"], [2, "ajkss"]], convert(ret))
 
+    def testBuffer(self):
+        with STPyV8.JSContext() as ctxt:
+            array = ctxt.eval("var u8 = new Uint8Array([1, 2, 3, 4]); u8")
+
+            self.assertTrue(isinstance(array, STPyV8.JSBuffer))
+            self.assertEqual(4, len(array))
+
+            view = memoryview(array)
+
+            self.assertEqual("B", view.format)
+            self.assertEqual([1, 2, 3, 4], view.tolist())
+
+            view[0] = 42
+            self.assertEqual(42, ctxt.eval("u8[0]"))
+
+            floats = ctxt.eval("new Float64Array([0.5, 1.5]).subarray(1)")
+
+            self.assertEqual("d", floats.format)
+            self.assertEqual(8, floats.byteLength)
+            self.assertEqual([1.5], memoryview(floats).tolist())
+
+            buffer = ctxt.eval("u8.buffer")
+
+            self.assertEqual(4, buffer.byteLength)
+            self.assertEqual(b"\x2a\x02\x03\x04", bytes(buffer))
+
+            shared = ctxt.eval("new DataView(new SharedArrayBuffer(8), 2, 4)")
+
+            self.assertEqual(4, len(memoryview(shared)))
+
+            view.release()
+            del array
+
+            self.assertEqual([2, 3, 4], memoryview(ctxt.eval("u8.subarray(1)")).tolist())
+
+    def testPythonBuffer(self):
+        with STPyV8.JSContext() as ctxt:
+            data = bytearray(b"abc")
+            ctxt.locals.data = data
+
+            self.assertEqual("Uint8Array", ctxt.eval("data.constructor.name"))
+            self.assertEqual(3, ctxt.eval("data.length"))
+
+            ctxt.eval("data[0] = 65")
+            self.assertEqual(bytearray(b"Abc"), data)
+
+            view = memoryview(b"xyz")
+            ctxt.locals.view = view
+
+            ctxt.eval("view[0] = 65")
+            self.assertEqual(b"xyz", view.tobytes())
+
+            strided = memoryview(bytearray(b"abcdef"))[::2]
+            ctxt.locals.strided = strided
+
+            self.assertEqual("undefined", ctxt.eval("typeof strided.byteLength"))
+            self.assertEqual(b"ace", strided.tobytes())
+
+            buf = STPyV8.JSBuffer(b"hello")
+            self.assertEqual(b"hello", bytes(buf))
+
+            ctxt.locals.buf = buf
+            self.assertEqual(104, ctxt.eval("buf[0]"))
+            self.assertEqual(5, len(buf))
+
+            self.assertRaises(TypeError, STPyV8.JSBuffer, 42)
+
     def testLazyConstructor(self):
         class Globals(STPyV8.JSClass):
             def __init__(self):
@@ -821,6 +1083,25 @@ class TestWrapper(unittest.TestCase):
 
             self.assertEqual(2, func("测试"))
 
+            codes = ctxt.eval(
+                "(function (msg) { return Array.from(msg, c => c.codePointAt(0)).join(); })"
+            )
+
+            self.assertEqual("97,233,255", codes("a\xe9\xff"))
+            self.assertEqual("20154,65535", codes("人\uffff"))
+            self.assertEqual("128512,97", codes("\U0001f600a"))
+
+            self.assertEqual(3, func("\U0001f600a"))
+            self.assertEqual("\U0001f600a", ctxt.eval("(function (msg) { return msg; })")("\U0001f600a"))
+
+            self.assertEqual("abc", ctxt.eval("'abc'"))
+            self.assertEqual("caf\xe9", ctxt.eval("'caf\\xe9'"))
+            self.assertEqual("\ufeff\u4eba", ctxt.eval("'\\ufeff\\u4eba'"))
+            self.assertEqual("ab", ctxt.eval("'\\u0100ab'.substring(1)"))
+            self.assertEqual("\U0001f600", ctxt.eval("String.fromCodePoint(0x1f600)"))
+            self.assertEqual("\ufffd", ctxt.eval("'\\ud800'"))
+            self.assertEqual("x" * 1000 + "\u4eba", ctxt.eval("'x'.repeat(1000) + '\\u4eba'"))
+
     def testClassicStyleObject(self):
         class FileSystemWrapper:
             @property
@@ -1009,6 +1290,96 @@ class TestWrapper(unittest.TestCase):
             self.assertEqual(10, ctxt.eval("obj.p"))
             self.assertEqual(10, ctxt.locals.d["y"])
 
+    def testWatchpoints(self):
+        class Obj(STPyV8.JSClass):
+            pass
+
+        with STPyV8.JSContext() as ctxt:
+            first, second = Obj(), Obj()
+
+            ctxt.locals.first = first
+            ctxt.locals.second = second
+
+            # set on an instance, or on the class after it was wrapped
+            first.__watchpoints__ = {"x": lambda name, old, new: new * 2}
+
+            ctxt.eval("first.x = 1; second.x = 1")
+
+            self.assertEqual(2, first.x)
+            self.assertEqual(1, second.x)
+
+            Obj.__watchpoints__ = {"y": lambda name, old, new: new + 1}
+
+            ctxt.eval("second.y = 1")
+
+            self.assertEqual(2, second.y)
+
+    def testNamedInterceptorNames(self):
+        class Global(STPyV8.JSClass):
+            def __init__(self):
+                self.obj = STPyV8.JSClass()
+                self.obj.value = 1
+                self.d = {"k\u00e9y": 2, "\u4e2d": 3}
+
+        with STPyV8.JSContext(Global()) as ctxt:
+            # the cached names must keep hitting the right attributes and keys
+            self.assertEqual(
+                3000,
+                ctxt.eval(
+                    """
+                var s = 0;
+                for (var i = 0; i < 1000; i++) { s += obj.value + d['k\u00e9y']; }
+                s;
+                """
+                ),
+            )
+            self.assertEqual(3, ctxt.eval("d['\u4e2d']"))
+
+            ctxt.eval("for (var i = 0; i < 10; i++) { d['k' + i] = i; }")
+            self.assertEqual(9, ctxt.locals.d["k9"])
+            self.assertTrue(ctxt.eval("'k5' in d"))
+            self.assertTrue(ctxt.eval("delete d.k5"))
+            self.assertFalse("k5" in ctxt.locals.d)
+
+            # symbols are not Python names, they are left to Javascript
+            self.assertEqual(None, ctxt.eval("obj[Symbol.iterator]"))
+            self.assertEqual(4, ctxt.eval("var sym = Symbol(); obj[sym] = 4; obj[sym]"))
+
+    def testTypeTemplates(self):
+        class Point(STPyV8.JSClass):
+            def __init__(self, x):
+                self.x = x
+
+        class Table(STPyV8.JSClass):
+            def __init__(self):
+                self.rows = {"a": 1}
+
+            def __getitem__(self, key):
+                return self.rows[key]
+
+            def keys(self):
+                return self.rows.keys()
+
+        def gen():
+            yield 1
+            yield 2
+
+        with STPyV8.JSContext() as ctxt:
+            f = ctxt.eval(
+                """
+            (function (points, items, mapping, table, generator) {
+                var s = 0;
+                for (var i = 0; i < 10; i++) { s += points[i].x; }
+                points[0][0] = 'js';
+                return [s, points[0][0], items[1], mapping.b, table.a, generator[0] === undefined, Object.keys(mapping).length];
+            })
+            """
+            )
+            result = f([Point(i) for i in range(10)], [1, 2, 3], {"b": 4}, Table(), gen())
+
+            # a plain object keeps its indexed properties on the Javascript side
+            self.assertEqual([45, "js", 2, 4, 1, True, 1], list(result))
+
     def testWatch(self):
         class Obj(STPyV8.JSClass):
             def __init__(self):